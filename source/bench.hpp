@@ -0,0 +1,859 @@
+//
+// Benchmark command to time each phase of the decimation on the active mesh layers.
+//
+
+#pragma once
+
+#include "decimate.hpp"
+#include "profile.hpp"
+#include "generate.hpp"
+
+#include <lxsdk/lx_layer.hpp>
+#include <lxsdk/lx_item.hpp>
+#include <lxsdk/lxu_command.hpp>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+#define BENCHs_FILE      "file"
+#define BENCHs_BASELINE  "baseline"
+#define BENCHs_THRESHOLD "threshold"
+#define BENCHs_RATIO     "ratio"
+#define BENCHs_REPEAT    "repeat"
+#define BENCHs_GENERATOR "generator"
+#define BENCHs_SIZES     "sizes"
+#define BENCHs_THREADS   "threads"
+#define BENCHs_COST      "costStrategy"
+#define BENCHs_STATS     "stats"
+#define BENCHs_MEMBUDGET "memBudget"
+#define BENCHs_CLUSTER   "cluster"
+#define BENCHs_REORDER   "reorder"
+
+#define BENCHa_FILE      0
+#define BENCHa_BASELINE  1
+#define BENCHa_THRESHOLD 2
+#define BENCHa_RATIO     3
+#define BENCHa_REPEAT    4
+#define BENCHa_GENERATOR 5
+#define BENCHa_SIZES     6
+#define BENCHa_THREADS   7
+#define BENCHa_COST      8
+#define BENCHa_STATS     9
+#define BENCHa_MEMBUDGET 10
+#define BENCHa_CLUSTER   11
+#define BENCHa_REORDER   12
+
+//
+// Timing result of one mesh with one cost strategy and constraint option.
+//
+struct CBenchRun
+{
+    std::string mesh;
+    int         cost;
+    int         preserveBoundary;
+    int         preserveMaterial;
+    int         cluster = 0;
+    int         reorder = 0;
+    size_t      triangles;
+    CPhaseTimes times;
+    CTriangulateStats polygons;
+    bool        has_stats = false;
+    CCollapseStats stats;
+    CMemoryReport  memory;
+    bool        has_error = false;
+    double      max_error = 0.0;    // maximum distance from the source vertices, by the bounding box diagonal
+    double      rms_error = 0.0;    // root mean square of the distances
+
+    std::string Key() const
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "/%d/%d/%d%s%s", cost, preserveBoundary, preserveMaterial, cluster ? "/cluster" : "",
+                 reorder ? "/reorder" : "");
+        return mesh + buf;
+    }
+};
+
+//
+// Resident set size of a stage of the run: at its end and the high-water mark during it.
+//
+struct CRssStage
+{
+    size_t end  = 0;
+    size_t peak = 0;
+};
+
+//
+// Timing result of one generated mesh size with one thread count. Only the vertex clustering
+// and the result lists (MakeResult) run on worker threads, so the rest of the phases do not
+// depend on the thread count.
+//
+struct CScaleRun
+{
+    enum Stage { Build, Convert, Collapse, Writeback, Stages };
+
+    unsigned    size;
+    int         threads;
+    int         cluster = 0;
+    size_t      triangles;
+    double      result = 0.0;       // MakeResult in milliseconds
+    size_t      rss_before = 0;     // resident set size before the run in bytes
+    CRssStage   rss[Stages];        // of the stages of the first run
+    CPhaseTimes times;
+
+    static const char* StageName(unsigned i)
+    {
+        static const char* names[Stages] = { "build", "convert", "collapse", "writeback" };
+        return names[i];
+    }
+
+    // High-water mark of the whole run.
+    size_t PeakRSS() const
+    {
+        size_t peak = rss_before;
+        for (auto& stage : rss)
+            peak = std::max(peak, stage.peak);
+        return peak;
+    }
+};
+
+namespace BenchUtil {
+
+static const char* CostName(int cost)
+{
+    switch (cost)
+    {
+        case CDecimate::Edge_Length:
+            return "Edge_Length";
+        case CDecimate::Lindstrom_Turk:
+            return "Lindstrom_Turk";
+        case CDecimate::Garland_Heckbert:
+            return "Garland_Heckbert";
+    }
+    return "Unknown";
+}
+
+//
+// Take the fastest time of each phase over the repeated runs.
+//
+static void MinTimes(CPhaseTimes& a, const CPhaseTimes& b)
+{
+    for (auto i = 0u; i < CPhaseTimes::Count; i++)
+        a.Phase(i) = std::min(a.Phase(i), b.Phase(i));
+}
+
+//
+// Escape the string for a JSON string literal.
+//
+static std::string EscapeJSON(const std::string& text)
+{
+    std::string out;
+    out.reserve(text.size());
+    for (unsigned char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += static_cast<char>(c);
+        }
+        else if (c < 0x20)
+        {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else
+            out += static_cast<char>(c);
+    }
+    return out;
+}
+
+static void WritePhases(FILE* fp, const CPhaseTimes& t)
+{
+    fprintf(fp, "\"phases\": { ");
+    for (auto i = 0u; i < CPhaseTimes::Count; i++)
+        fprintf(fp, "\"%s\": %.3f%s", CPhaseTimes::Name(i), t.Phase(i), (i + 1 < CPhaseTimes::Count) ? ", " : " ");
+    fprintf(fp, "}, \"total\": %.3f", t.Total());
+}
+
+static void WriteMemorySnapshot(FILE* fp, const char* name, const CMemorySnapshot& snap)
+{
+    fprintf(fp, "\"%s\": { ", name);
+    for (auto i = 0u; i < MP_Count; i++)
+    {
+        const CMemoryUsage& u = snap.pool[i];
+        fprintf(fp, "\"%s\": { \"bytes\": %lld, \"count\": %lld, \"peak\": %lld }, ", CMemorySnapshot::Name(i),
+                static_cast<long long>(u.bytes), static_cast<long long>(u.count), static_cast<long long>(u.peak));
+    }
+    fprintf(fp, "\"total\": %lld }", static_cast<long long>(snap.Bytes()));
+}
+
+static void WriteMemory(FILE* fp, const CMemoryReport& mem)
+{
+    fprintf(fp, ", \"memory\": { ");
+    WriteMemorySnapshot(fp, "build", mem.build);
+    fprintf(fp, ", ");
+    WriteMemorySnapshot(fp, "convert", mem.convert);
+    fprintf(fp, ", ");
+    WriteMemorySnapshot(fp, "decimate", mem.decimate);
+    fprintf(fp, ", \"peak\": %lld }", static_cast<long long>(mem.decimate.Peak()));
+}
+
+//
+// Write the number of source polygons by triangulation method.
+//
+static void WritePolygons(FILE* fp, const CTriangulateStats& st)
+{
+    fprintf(fp, ", \"polygons\": { \"simple\": %u, \"convex\": %u, \"cdt\": %u, \"fallback\": %u, \"failed\": %u, \"generated\": %u }",
+            st.simple, st.convex, st.cdt, st.fallback, st.failed, st.generated);
+}
+
+static void WriteStats(FILE* fp, const CCollapseStats& st)
+{
+    fprintf(fp, ", \"stats\": { \"selected\": %llu, \"collapsed\": %llu, \"topology\": %llu, \"constraint\": %llu, "
+                "\"noCost\": %llu, \"placementFallback\": %llu, \"constrainedEdges\": %llu, \"maxCost\": %g, \"histogram\": [",
+            static_cast<unsigned long long>(st.selected), static_cast<unsigned long long>(st.collapsed),
+            static_cast<unsigned long long>(st.topology), static_cast<unsigned long long>(st.constraint),
+            static_cast<unsigned long long>(st.no_cost), static_cast<unsigned long long>(st.placement_fallback),
+            static_cast<unsigned long long>(st.constrained_edges), st.max_cost);
+    for (auto i = 0u; i < CCollapseStats::Bins; i++)
+        fprintf(fp, "%s%llu", i ? ", " : " ", static_cast<unsigned long long>(st.histogram[i]));
+    fprintf(fp, " ] }");
+}
+
+//
+// Current resident set size of this process in bytes.
+//
+static size_t CurrentRSS()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS info;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &info, sizeof(info)))
+        return static_cast<size_t>(info.WorkingSetSize);
+    return 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t      count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+        return 0;
+    return static_cast<size_t>(info.resident_size);
+#else
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (!fp)
+        return 0;
+    unsigned long pages = 0, resident = 0;
+    int n = fscanf(fp, "%lu %lu", &pages, &resident);
+    fclose(fp);
+    if (n != 2)
+        return 0;
+    return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+//
+// Sample the current resident set size on a thread to take the high-water mark of each stage.
+// The process lifetime peak of the OS is not reset between runs, so it is not used.
+//
+class CRssSampler
+{
+public:
+    CRssSampler()
+        : m_peak(CurrentRSS())
+    {
+        m_thread = std::thread([this]() {
+            while (!m_stop.load())
+            {
+                Sample();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    }
+
+    ~CRssSampler()
+    {
+        m_stop.store(true);
+        m_thread.join();
+    }
+
+    // End the stage and start the next one from the current size.
+    CRssStage Mark()
+    {
+        CRssStage stage;
+        stage.end  = CurrentRSS();
+        stage.peak = std::max(m_peak.exchange(stage.end), stage.end);
+        return stage;
+    }
+
+private:
+    void Sample()
+    {
+        size_t rss  = CurrentRSS();
+        size_t peak = m_peak.load();
+        while (rss > peak && !m_peak.compare_exchange_weak(peak, rss))
+            ;
+    }
+
+    std::atomic<size_t> m_peak;
+    std::atomic<bool>   m_stop{false};
+    std::thread         m_thread;
+};
+
+//
+// Parse comma separated integer list such as "10000,100000,1000000".
+//
+template <typename T>
+static std::vector<T> ParseList(const std::string& text, T value)
+{
+    std::vector<T>     list;
+    std::stringstream  ss(text);
+    std::string        item;
+    while (std::getline(ss, item, ','))
+    {
+        try
+        {
+            list.push_back(static_cast<T>(std::stoll(item)));
+        }
+        catch (...)
+        {
+        }
+    }
+    if (list.empty())
+        list.push_back(value);
+    return list;
+}
+
+//
+// Write the scaling study results to JSON file. Throughput is triangles per second of each
+// phase. The scaling efficiency is relative to the first thread count of the same size, and
+// it is written only for the parallel stages: cluster (with cluster) and result.
+//
+static bool WriteScaleJSON(const std::string& filename, int gen, int cost, double ratio, const std::vector<CScaleRun>& runs)
+{
+    FILE* fp = fopen(filename.c_str(), "w");
+    if (!fp)
+        return false;
+
+    fprintf(fp, "{\n  \"version\": 1,\n  \"generator\": \"%s\",\n  \"cost\": \"%s\",\n  \"ratio\": %.4f,\n  \"runs\": [\n",
+            MeshGen::GeneratorName(gen), CostName(cost), ratio);
+    for (auto i = 0u; i < runs.size(); i++)
+    {
+        const CScaleRun& run = runs[i];
+        const CScaleRun* ref = &run;
+        for (auto& r : runs)
+        {
+            if (r.size == run.size)
+            {
+                ref = &r;
+                break;
+            }
+        }
+        fprintf(fp, "    { \"size\": %u, \"threads\": %d, \"triangles\": %zu, \"peakRSS\": %zu, \"rss\": { \"before\": %zu",
+                run.size, run.threads, run.triangles, run.PeakRSS(), run.rss_before);
+        for (auto k = 0u; k < CScaleRun::Stages; k++)
+            fprintf(fp, ", \"%s\": { \"end\": %zu, \"peak\": %zu }", CScaleRun::StageName(k), run.rss[k].end, run.rss[k].peak);
+        fprintf(fp, " }, ");
+        WritePhases(fp, run.times);
+        fprintf(fp, ", \"throughput\": { ");
+        for (auto k = 0u; k < CPhaseTimes::Count; k++)
+        {
+            double ms = run.times.Phase(k);
+            double tp = (ms > 0.0) ? run.triangles / (ms * 0.001) : 0.0;
+            fprintf(fp, "\"%s\": %.1f%s", CPhaseTimes::Name(k), tp, (k + 1 < CPhaseTimes::Count) ? ", " : " ");
+        }
+        fprintf(fp, "}, \"result\": %.3f, \"efficiency\": { ", run.result);
+        if (run.cluster)
+        {
+            double ms = run.times.cluster * run.threads;
+            fprintf(fp, "\"cluster\": %.3f, ", (ms > 0.0) ? ref->times.cluster * ref->threads / ms : 1.0);
+        }
+        double ms = run.result * run.threads;
+        fprintf(fp, "\"result\": %.3f } }%s\n", (ms > 0.0) ? ref->result * ref->threads / ms : 1.0,
+                (i + 1 < runs.size()) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    return true;
+}
+
+//
+// Write the benchmark results to JSON file.
+//
+static bool WriteJSON(const std::string& filename, double ratio, const std::vector<CBenchRun>& runs)
+{
+    FILE* fp = fopen(filename.c_str(), "w");
+    if (!fp)
+        return false;
+
+    fprintf(fp, "{\n  \"version\": 1,\n  \"ratio\": %.4f,\n  \"runs\": [\n", ratio);
+    for (auto i = 0u; i < runs.size(); i++)
+    {
+        const CBenchRun& run = runs[i];
+        fprintf(fp, "    { \"key\": \"%s\", \"mesh\": \"%s\", \"triangles\": %zu, \"cost\": \"%s\", "
+                    "\"preserveBoundary\": %d, \"preserveMaterial\": %d, ",
+                EscapeJSON(run.Key()).c_str(), EscapeJSON(run.mesh).c_str(), run.triangles, CostName(run.cost),
+                run.preserveBoundary, run.preserveMaterial);
+        WritePhases(fp, run.times);
+        WritePolygons(fp, run.polygons);
+        WriteMemory(fp, run.memory);
+        if (run.has_stats)
+            WriteStats(fp, run.stats);
+        if (run.reorder)
+            fprintf(fp, ", \"reorder\": 1");
+        if (run.has_error)
+            fprintf(fp, ", \"cluster\": %d, \"error\": { \"max\": %.6g, \"rms\": %.6g }", run.cluster, run.max_error, run.rms_error);
+        fprintf(fp, " }%s\n", (i + 1 < runs.size()) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    return true;
+}
+
+//
+// Read the phase timings from the baseline JSON file written by WriteJSON.
+//
+static bool ReadBaseline(const std::string& filename, std::map<std::string, CPhaseTimes>& baseline)
+{
+    namespace pt = boost::property_tree;
+
+    pt::ptree root;
+    try
+    {
+        pt::read_json(filename, root);
+        for (auto& node : root.get_child("runs"))
+        {
+            const pt::ptree& run = node.second;
+            CPhaseTimes t;
+            for (auto i = 0u; i < CPhaseTimes::Count; i++)
+                t.Phase(i) = run.get<double>(std::string("phases.") + CPhaseTimes::Name(i), 0.0);
+            baseline[run.get<std::string>("key")] = t;
+        }
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return true;
+}
+
+//
+// Return true when the current time exceeds the baseline by more than the threshold.
+// Differences below one millisecond are treated as noise.
+//
+static bool IsRegressed(double current, double base, double threshold)
+{
+    return (current > base * (1.0 + threshold)) && (current - base > 1.0);
+}
+
+//
+// Compare the runs with the baseline and return the number of regressed phases.
+//
+static unsigned CompareBaseline(const std::vector<CBenchRun>& runs, const std::map<std::string, CPhaseTimes>& baseline, double threshold)
+{
+    unsigned nregress = 0;
+
+    for (auto& run : runs)
+    {
+        auto it = baseline.find(run.Key());
+        if (it == baseline.end())
+            continue;
+
+        const CPhaseTimes& cur  = run.times;
+        const CPhaseTimes& base = it->second;
+
+        for (auto i = 0u; i <= CPhaseTimes::Count; i++)
+        {
+            const char* name = (i < CPhaseTimes::Count) ? CPhaseTimes::Name(i) : "total";
+            double      t0   = (i < CPhaseTimes::Count) ? cur.Phase(i) : cur.Total();
+            double      t1   = (i < CPhaseTimes::Count) ? base.Phase(i) : base.Total();
+            if (IsRegressed(t0, t1, threshold))
+            {
+                printf("Regression %s %s: %.3f ms (baseline %.3f ms)\n", run.Key().c_str(), name, t0, t1);
+                nregress ++;
+            }
+        }
+    }
+    return nregress;
+}
+
+}; // BenchUtil
+
+//
+// Benchmark command. This decimates every active mesh layer with all cost strategies and
+// constraint options, and writes the timing of each phase to JSON file. When the baseline
+// JSON file is given, the phases slower than the threshold are reported as regressions.
+//
+// The accounted memory of each subsystem is written for every run, and the runs of which the
+// peak exceeds memBudget (MB) fail the command.
+// With stats, the collapse statistics of the first run are written next to the timings.
+// With cluster, every setting is also run with the vertex clustering stage, and the error of
+// both runs is written to compare the two-stage decimation with the single-stage one.
+// With reorder, every setting is also run with the mesh built in Morton order, and the collapse
+// time of both orders is printed.
+//
+// When a generator is given, this runs the scaling study instead. A synthetic mesh is generated
+// for each size, and it is decimated with each thread count. The thread count only changes the
+// parallel stages: the vertex clustering (with cluster) and MakeResult.
+//
+class CBench : public CLxBasicCommand
+{
+public:
+    CBench()
+    {
+        static const LXtTextValueHint generator_hint[] = {
+            { MeshGen::None, "none" },
+            { MeshGen::Sphere, "sphere" },
+            { MeshGen::Terrain, "terrain" },
+            { MeshGen::Kitbash, "kitbash" },
+            { MeshGen::Slab, "slab" },
+            { MeshGen::Fan, "fan" },
+            { MeshGen::Panel, "panel" },
+            { 0, "=decimate_generator" }, 0
+        };
+        static const LXtTextValueHint decimate_cost[] = {
+            { CDecimate::Edge_Length, "Edge_Length" }, 
+            { CDecimate::Lindstrom_Turk, "Lindstrom_Turk" }, 
+            { CDecimate::Garland_Heckbert, "Garland_Heckbert" }, 
+            { 0, "=decimate_cost" }, 0
+        };
+
+        dyna_Add(BENCHs_FILE, LXsTYPE_FILEPATH);
+        dyna_Add(BENCHs_BASELINE, LXsTYPE_FILEPATH);
+        dyna_Add(BENCHs_THRESHOLD, LXsTYPE_PERCENT);
+        dyna_Add(BENCHs_RATIO, LXsTYPE_PERCENT);
+        dyna_Add(BENCHs_REPEAT, LXsTYPE_INTEGER);
+        dyna_Add(BENCHs_GENERATOR, LXsTYPE_INTEGER);
+        dyna_SetHint(BENCHa_GENERATOR, generator_hint);
+        dyna_Add(BENCHs_SIZES, LXsTYPE_STRING);
+        dyna_Add(BENCHs_THREADS, LXsTYPE_STRING);
+        dyna_Add(BENCHs_COST, LXsTYPE_INTEGER);
+        dyna_SetHint(BENCHa_COST, decimate_cost);
+        dyna_Add(BENCHs_STATS, LXsTYPE_BOOLEAN);
+        dyna_Add(BENCHs_MEMBUDGET, LXsTYPE_INTEGER);
+        dyna_Add(BENCHs_CLUSTER, LXsTYPE_BOOLEAN);
+        dyna_Add(BENCHs_REORDER, LXsTYPE_BOOLEAN);
+
+        basic_SetFlags(BENCHa_BASELINE, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(BENCHa_THRESHOLD, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(BENCHa_RATIO, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(BENCHa_REPEAT, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(BENCHa_GENERATOR, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(BENCHa_SIZES, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(BENCHa_THREADS, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(BENCHa_COST, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(BENCHa_STATS, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(BENCHa_MEMBUDGET, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(BENCHa_CLUSTER, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(BENCHa_REORDER, LXfCMDARG_OPTIONAL);
+    }
+
+    static void initialize()
+    {
+        CLxGenericPolymorph* srv;
+
+        srv = new CLxPolymorph<CBench>;
+        srv->AddInterface(new CLxIfc_Command<CBench>);
+        srv->AddInterface(new CLxIfc_Attributes<CBench>);
+        srv->AddInterface(new CLxIfc_AttributesUI<CBench>);
+        lx::AddServer("decimate.bench", srv);
+    }
+
+    int basic_CmdFlags()
+    {
+        return 0;
+    }
+
+    void basic_Execute(unsigned int flags)
+    {
+        CLxUser_LayerService lyr_S;
+        CLxUser_MeshService  msh_S;
+        CLxUser_LayerScan    scan;
+        CLxUser_Mesh         base_mesh, scratch;
+        CLxUser_Item         item;
+        std::string          filename, baseline_file;
+        double               threshold = 0.1, ratio = 0.1;
+        int                  repeat = 1;
+        int                  stats = 0;
+        int                  budget = 0;
+        int                  cluster = 0;
+        int                  reorder = 0;
+        unsigned             nover = 0;
+        unsigned             n;
+
+        dyna_String(BENCHa_FILE, filename);
+        if (dyna_IsSet(BENCHa_BASELINE))
+            dyna_String(BENCHa_BASELINE, baseline_file);
+        if (dyna_IsSet(BENCHa_THRESHOLD))
+            attr_GetFlt(BENCHa_THRESHOLD, &threshold);
+        if (dyna_IsSet(BENCHa_RATIO))
+            attr_GetFlt(BENCHa_RATIO, &ratio);
+        if (dyna_IsSet(BENCHa_REPEAT))
+            attr_GetInt(BENCHa_REPEAT, &repeat);
+        if (repeat < 1)
+            repeat = 1;
+        if (dyna_IsSet(BENCHa_STATS))
+            attr_GetInt(BENCHa_STATS, &stats);
+        if (dyna_IsSet(BENCHa_MEMBUDGET))
+            attr_GetInt(BENCHa_MEMBUDGET, &budget);
+        if (dyna_IsSet(BENCHa_CLUSTER))
+            attr_GetInt(BENCHa_CLUSTER, &cluster);
+        if (dyna_IsSet(BENCHa_REORDER))
+            attr_GetInt(BENCHa_REORDER, &reorder);
+
+        int generator = MeshGen::None;
+        if (dyna_IsSet(BENCHa_GENERATOR))
+            attr_GetInt(BENCHa_GENERATOR, &generator);
+        if (generator != MeshGen::None)
+        {
+            ScaleStudy(generator, filename, ratio, repeat);
+            return;
+        }
+
+        std::vector<CBenchRun> runs;
+
+        lyr_S.BeginScan(LXf_LAYERSCAN_ACTIVE, scan);
+        scan.Count(&n);
+
+        for (auto i = 0u; i < n; i++)
+        {
+            scan.BaseMeshByIndex(i, base_mesh);
+
+            const char* name = "mesh";
+            if (scan.MeshItem(i, item))
+                item.UniqueName(&name);
+
+            for (auto cost : { CDecimate::Edge_Length, CDecimate::Lindstrom_Turk, CDecimate::Garland_Heckbert })
+            {
+                // With cluster, each setting is run without and with the clustering stage, and
+                // with reorder, each of them in the polygon order and in Morton order.
+                int variants = (cluster ? 2 : 1) * (reorder ? 2 : 1);
+                for (auto setting = 0; setting < 4 * variants; setting++)
+                {
+                    int constraint = setting & 3;
+                    CBenchRun run;
+                    run.mesh             = name;
+                    run.cost             = cost;
+                    run.preserveBoundary = constraint & 1;
+                    run.preserveMaterial = (constraint >> 1) & 1;
+                    run.cluster          = cluster ? (setting >> 2) & 1 : 0;
+                    run.reorder          = reorder ? setting / (4 * (cluster ? 2 : 1)) : 0;
+
+                    for (auto k = 0; k < repeat; k++)
+                    {
+                        CDecimate dec;
+                        dec.m_mode             = CDecimate::Ratio;
+                        dec.m_ratio            = ratio;
+                        dec.m_cost             = cost;
+                        dec.m_preserveBoundary = run.preserveBoundary;
+                        dec.m_preserveMaterial = run.preserveMaterial;
+                        dec.m_collectStats     = (stats && k == 0) ? 1 : 0;
+                        dec.m_cluster          = run.cluster;
+                        dec.m_reorder          = run.reorder;
+
+                        dec.DecimateMesh(base_mesh);
+                        if (cluster && k == 0)
+                        {
+                            dec.MeasureError(run.max_error, run.rms_error);
+                            run.has_error = true;
+                        }
+
+                        // write back into a scratch mesh to time the writeback phase.
+                        if (msh_S.NewMesh(scratch))
+                            dec.m_cmesh.WriteMesh(scratch);
+
+                        if (k == 0)
+                        {
+                            run.triangles = dec.m_cmesh.m_triangles.size();
+                            run.times     = dec.m_cmesh.m_times;
+                            run.polygons  = dec.m_cmesh.m_triStats;
+                            run.has_stats = stats != 0;
+                            run.stats     = dec.m_stats;
+                            run.memory    = dec.m_memory;
+                        }
+                        else
+                            BenchUtil::MinTimes(run.times, dec.m_cmesh.m_times);
+                    }
+                    printf("Bench %s: %zu triangles %.3f ms %lld KB\n", run.Key().c_str(), run.triangles, run.times.Total(),
+                           static_cast<long long>(run.memory.decimate.Peak() >> 10));
+                    unsigned ngons = run.polygons.convex + run.polygons.cdt;
+                    if (ngons > 0)
+                        printf("Bench %s: %u of %u n-gons by convex fan (%.1f%%), triangulate %.3f ms\n", run.Key().c_str(),
+                               run.polygons.convex, ngons, 100.0 * run.polygons.convex / ngons, run.times.triangulate);
+                    if (budget > 0 && run.memory.decimate.Peak() > static_cast<int64_t>(budget) * 1024 * 1024)
+                    {
+                        printf("Memory budget exceeded %s: %lld MB (budget %d MB)\n", run.Key().c_str(),
+                               static_cast<long long>(run.memory.decimate.Peak() >> 20), budget);
+                        nover ++;
+                    }
+                    if (run.cluster)
+                    {
+                        const CBenchRun& single = runs[runs.size() - 4];
+                        printf("Bench %s: two-stage %.3f ms error max %.3g rms %.3g, single-stage %.3f ms error max %.3g rms %.3g\n",
+                               run.Key().c_str(), run.times.Total(), run.max_error, run.rms_error,
+                               single.times.Total(), single.max_error, single.rms_error);
+                    }
+                    if (run.reorder)
+                    {
+                        const CBenchRun& unordered = runs[runs.size() - 4 * (cluster ? 2 : 1)];
+                        printf("Bench %s: collapse %.3f ms in Morton order (reorder %.3f ms), %.3f ms in polygon order\n",
+                               run.Key().c_str(), run.times.collapse, run.times.reorder, unordered.times.collapse);
+                    }
+                    runs.push_back(run);
+                }
+            }
+        }
+        scan.Apply();
+
+        if (!filename.empty() && !BenchUtil::WriteJSON(filename, ratio, runs))
+        {
+            basic_Message().SetCode(LXe_FAILED);
+            return;
+        }
+
+        if (nover > 0)
+            basic_Message().SetCode(LXe_FAILED);
+
+        if (!baseline_file.empty())
+        {
+            std::map<std::string, CPhaseTimes> baseline;
+            if (!BenchUtil::ReadBaseline(baseline_file, baseline))
+            {
+                basic_Message().SetCode(LXe_FAILED);
+                return;
+            }
+            if (BenchUtil::CompareBaseline(runs, baseline, threshold) > 0)
+                basic_Message().SetCode(LXe_FAILED);
+        }
+    }
+
+    //
+    // Sweep the generated mesh size and the number of threads. The collapse pipeline is serial,
+    // so only the clustering and the MakeResult times are compared between the thread counts.
+    //
+    void ScaleStudy(int generator, const std::string& filename, double ratio, int repeat)
+    {
+        CLxUser_MeshService msh_S;
+        std::string         sizes_text, threads_text;
+        int                 cost = CDecimate::Lindstrom_Turk;
+        int                 cluster = 0;
+
+        if (dyna_IsSet(BENCHa_SIZES))
+            dyna_String(BENCHa_SIZES, sizes_text);
+        if (dyna_IsSet(BENCHa_THREADS))
+            dyna_String(BENCHa_THREADS, threads_text);
+        if (dyna_IsSet(BENCHa_COST))
+            attr_GetInt(BENCHa_COST, &cost);
+        if (dyna_IsSet(BENCHa_CLUSTER))
+            attr_GetInt(BENCHa_CLUSTER, &cluster);
+
+        std::vector<unsigned> sizes   = BenchUtil::ParseList<unsigned>(sizes_text, 10000u);
+        std::vector<int>      threads = BenchUtil::ParseList<int>(threads_text, 1);
+
+        std::vector<CScaleRun> runs;
+
+        for (auto size : sizes)
+        {
+            CLxUser_Mesh source;
+            if (!msh_S.NewMesh(source))
+            {
+                basic_Message().SetCode(LXe_FAILED);
+                return;
+            }
+            MeshGen::Generate(source, generator, size);
+
+            for (auto nthread : threads)
+            {
+                CScaleRun run;
+                run.size    = size;
+                run.threads = std::max(1, nthread);
+                run.cluster = cluster;
+
+                for (auto k = 0; k < repeat; k++)
+                {
+                    CDecimate    dec;
+                    CLxUser_Mesh scratch;
+                    dec.m_mode             = CDecimate::Ratio;
+                    dec.m_ratio            = ratio;
+                    dec.m_cost             = cost;
+                    dec.m_preserveBoundary = 0;
+                    dec.m_preserveMaterial = 0;
+                    dec.m_threads          = run.threads;
+                    dec.m_cluster          = run.cluster;
+
+                    // The resident set size of the stages is sampled on the first run. The
+                    // build and the conversion end where DecimateMesh reports them done.
+                    std::unique_ptr<BenchUtil::CRssSampler> sampler;
+                    if (k == 0)
+                    {
+                        run.rss_before = BenchUtil::CurrentRSS();
+                        sampler.reset(new BenchUtil::CRssSampler);
+                        dec.m_progress = [&](const char* phase, double fraction) {
+                            if (fraction >= 1.0 && !strcmp(phase, "triangulate"))
+                                run.rss[CScaleRun::Build] = sampler->Mark();
+                            else if (fraction >= 1.0 && !strcmp(phase, "convert"))
+                                run.rss[CScaleRun::Convert] = sampler->Mark();
+                            return true;
+                        };
+                    }
+
+                    dec.DecimateMesh(source);
+                    if (sampler)
+                        run.rss[CScaleRun::Collapse] = sampler->Mark();
+
+                    CDecimateResult result;
+                    CStopwatch      watch;
+                    dec.m_cmesh.MakeResult(false, result);
+                    double result_ms = watch.Elapsed();
+
+                    if (msh_S.NewMesh(scratch))
+                        dec.m_cmesh.WriteMesh(scratch);
+                    if (sampler)
+                        run.rss[CScaleRun::Writeback] = sampler->Mark();
+
+                    if (k == 0)
+                    {
+                        run.triangles = dec.m_cmesh.m_triangles.size();
+                        run.times     = dec.m_cmesh.m_times;
+                        run.result    = result_ms;
+                    }
+                    else
+                    {
+                        BenchUtil::MinTimes(run.times, dec.m_cmesh.m_times);
+                        run.result = std::min(run.result, result_ms);
+                    }
+                }
+                printf("Scale %s size %u: %zu triangles %.3f ms peak %zu MB (before %zu MB)\n",
+                       MeshGen::GeneratorName(generator), run.size, run.triangles, run.times.Total(),
+                       run.PeakRSS() >> 20, run.rss_before >> 20);
+                printf("  parallel stages with %d threads: cluster %.3f ms result %.3f ms\n",
+                       run.threads, run.times.cluster, run.result);
+                runs.push_back(run);
+            }
+        }
+
+        if (!filename.empty() && !BenchUtil::WriteScaleJSON(filename, generator, cost, ratio, runs))
+            basic_Message().SetCode(LXe_FAILED);
+    }
+};
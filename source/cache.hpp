@@ -0,0 +1,301 @@
+//
+// Result cache of the decimation keyed by the mesh content and the decimation parameters.
+//
+#pragma once
+
+#include <lxsdk/lx_mesh.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "decimate.hpp"
+
+//
+// 64-bit FNV-1a hash.
+//
+struct CContentHash
+{
+    uint64_t value = 14695981039346656037ull;
+
+    void Add(const void* data, size_t size)
+    {
+        auto bytes = static_cast<const unsigned char*>(data);
+        for (auto i = 0u; i < size; i++)
+        {
+            value ^= bytes[i];
+            value *= 1099511628211ull;
+        }
+    }
+
+    template <typename T>
+    void Add(const T& v)
+    {
+        Add(&v, sizeof(T));
+    }
+
+    void Add(const char* str)
+    {
+        if (str)
+            Add(str, std::strlen(str) + 1);
+        else
+            Add('\0');
+    }
+};
+
+//
+// Hash of the mesh content which affects the decimation: point positions, polygon types,
+// vertex lists, selection, hide and lock marks, material tags and locked edges. The positions
+// are skipped to hash the topology only.
+//
+static uint64_t MeshContentHash(CLxUser_Mesh& mesh, bool positions = true)
+{
+    PROFILE_SCOPE("cache.hash");
+    CLxUser_MeshService mesh_svc;
+    LXtMarkMode pick = mesh_svc.SetMode(LXsMARK_SELECT);
+    LXtMarkMode hide = mesh_svc.SetMode(LXsMARK_HIDE);
+    LXtMarkMode lock = mesh_svc.SetMode(LXsMARK_LOCK);
+
+    CLxUser_Point   vert;
+    CLxUser_Polygon poly;
+    CLxUser_Edge    edge;
+    vert.fromMesh(mesh);
+    poly.fromMesh(mesh);
+    edge.fromMesh(mesh);
+
+    CContentHash hash;
+    unsigned npnt = 0, npol = 0, nedge = 0;
+    mesh.PointCount(&npnt);
+    mesh.PolygonCount(&npol);
+    mesh.EdgeCount(&nedge);
+    hash.Add(npnt);
+    hash.Add(npol);
+
+    for (auto i = 0u; positions && i < npnt; i++)
+    {
+        LXtFVector pos;
+        vert.SelectByIndex(i);
+        vert.Pos(pos);
+        hash.Add(pos);
+    }
+
+    CLxUser_StringTag tag;
+    for (auto i = 0u; i < npol; i++)
+    {
+        poly.SelectByIndex(i);
+        LXtID4   type;
+        unsigned nvert, marks = 0;
+        poly.Type(&type);
+        poly.VertexCount(&nvert);
+        hash.Add(type);
+        hash.Add(nvert);
+        for (auto j = 0u; j < nvert; j++)
+        {
+            LXtPointID vrt;
+            unsigned   index;
+            poly.VertexByIndex(j, &vrt);
+            vert.Select(vrt);
+            vert.Index(&index);
+            hash.Add(index);
+        }
+        if (poly.TestMarks(pick) == LXe_TRUE)
+            marks |= 1;
+        if (poly.TestMarks(hide) == LXe_TRUE)
+            marks |= 2;
+        if (poly.TestMarks(lock) == LXe_TRUE)
+            marks |= 4;
+        hash.Add(marks);
+        tag.set(poly);
+        hash.Add(tag.Value(LXi_PTAG_MATR));
+    }
+
+    for (auto i = 0u; i < nedge; i++)
+    {
+        edge.SelectByIndex(i);
+        if (edge.TestMarks(lock) != LXe_TRUE)
+            continue;
+        LXtPointID v0, v1;
+        unsigned   i0, i1;
+        edge.Endpoints(&v0, &v1);
+        vert.Select(v0);
+        vert.Index(&i0);
+        vert.Select(v1);
+        vert.Index(&i1);
+        hash.Add(std::min(i0, i1));
+        hash.Add(std::max(i0, i1));
+    }
+    return hash.value;
+}
+
+//
+// Cheap hash of the mesh by the counts and a strided sample of the point positions and the
+// polygons, which keys the preview without walking the whole mesh on the mouse-down frame.
+// Edits out of the sample are missed, so the exact results are keyed by MeshContentHash.
+//
+static uint64_t MeshSampleHash(CLxUser_Mesh& mesh, unsigned samples = 4096)
+{
+    PROFILE_SCOPE("cache.sample");
+    CLxUser_MeshService mesh_svc;
+    LXtMarkMode pick = mesh_svc.SetMode(LXsMARK_SELECT);
+
+    CLxUser_Point   vert;
+    CLxUser_Polygon poly;
+    vert.fromMesh(mesh);
+    poly.fromMesh(mesh);
+
+    CContentHash hash;
+    unsigned npnt = 0, npol = 0, nedge = 0;
+    mesh.PointCount(&npnt);
+    mesh.PolygonCount(&npol);
+    mesh.EdgeCount(&nedge);
+    hash.Add(npnt);
+    hash.Add(npol);
+    hash.Add(nedge);
+
+    unsigned stride = std::max(npnt / std::max(samples, 1u), 1u);
+    for (auto i = 0u; i < npnt; i += stride)
+    {
+        LXtFVector pos;
+        vert.SelectByIndex(i);
+        vert.Pos(pos);
+        hash.Add(pos);
+    }
+
+    stride = std::max(npol / std::max(samples, 1u), 1u);
+    for (auto i = 0u; i < npol; i += stride)
+    {
+        poly.SelectByIndex(i);
+        LXtID4   type;
+        unsigned nvert;
+        poly.Type(&type);
+        poly.VertexCount(&nvert);
+        hash.Add(type);
+        hash.Add(nvert);
+        for (auto j = 0u; j < nvert; j++)
+        {
+            LXtPointID vrt;
+            unsigned   index;
+            poly.VertexByIndex(j, &vrt);
+            vert.Select(vrt);
+            vert.Index(&index);
+            hash.Add(index);
+        }
+        hash.Add(poly.TestMarks(pick) == LXe_TRUE);
+    }
+    return hash.value;
+}
+
+//
+// Least recently used cache of the decimation results or sequences. The total bytes of the
+// entries are kept under the capacity by evicting the oldest ones.
+//
+template <typename T>
+class CLruCache
+{
+public:
+    typedef std::shared_ptr<const T> Result;
+
+    static CLruCache& Instance()
+    {
+        static CLruCache cache;
+        return cache;
+    }
+
+    Result Find(uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it == m_index.end())
+        {
+            m_misses ++;
+            return nullptr;
+        }
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        m_hits ++;
+        return it->second->second;
+    }
+
+    void Insert(uint64_t key, const Result& result)
+    {
+        size_t bytes = result->Bytes();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (bytes > m_capacity)
+            return;
+        auto it = m_index.find(key);
+        if (it != m_index.end())
+        {
+            m_bytes -= it->second->second->Bytes();
+            m_entries.erase(it->second);
+            m_index.erase(it);
+        }
+        m_entries.emplace_front(key, result);
+        m_index[key] = m_entries.begin();
+        m_bytes += bytes;
+        Evict();
+    }
+
+    void SetCapacity(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_capacity = bytes;
+        Evict();
+    }
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+        m_index.clear();
+        m_bytes = 0;
+    }
+
+    size_t Bytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_bytes;
+    }
+
+    uint64_t Hits() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_hits;
+    }
+
+    uint64_t Misses() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_misses;
+    }
+
+private:
+    CLruCache() = default;
+
+    void Evict()
+    {
+        while (m_bytes > m_capacity && !m_entries.empty())
+        {
+            auto& last = m_entries.back();
+            m_bytes -= last.second->Bytes();
+            m_index.erase(last.first);
+            m_entries.pop_back();
+        }
+    }
+
+    typedef std::list<std::pair<uint64_t, Result>> Entries;
+
+    Entries     m_entries;      // most recently used first
+    std::unordered_map<uint64_t, Entries::iterator> m_index;
+    size_t      m_capacity = 256u << 20;
+    size_t      m_bytes    = 0;
+    uint64_t    m_hits     = 0;
+    uint64_t    m_misses   = 0;
+    mutable std::mutex m_mutex;
+};
+
+typedef CLruCache<CDecimateResult>    CResultCache;
+typedef CLruCache<CAnimationSequence> CSequenceCache;
+typedef CLruCache<CCollapseLogData>   CLogCache;
@@ -0,0 +1,222 @@
+//
+// Vertex clustering of the internal mesh on a uniform grid. The vertices of each cell joined
+// by the edges inside the cell are merged into one placed at the minimum of their summed plane
+// quadrics, which reduces huge over-tessellated meshes in linear time before the edge collapse
+// refines the rest.
+//
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "cmesh.hpp"
+#include "util.hpp"
+
+//
+// Symmetric quadric of squared distances to planes: A = sum(n n^T), b = sum(d n), c = sum(d d).
+//
+struct CQuadric
+{
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+
+    void AddPlane(const LXtVector n, double d, double w)
+    {
+        a00 += w * n[0] * n[0];
+        a01 += w * n[0] * n[1];
+        a02 += w * n[0] * n[2];
+        a11 += w * n[1] * n[1];
+        a12 += w * n[1] * n[2];
+        a22 += w * n[2] * n[2];
+        b0  += w * d * n[0];
+        b1  += w * d * n[1];
+        b2  += w * d * n[2];
+        c   += w * d * d;
+    }
+
+    void Add(const CQuadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02;
+        a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0  += q.b0;  b1  += q.b1;  b2  += q.b2;
+        c   += q.c;
+    }
+
+    //
+    // Solve A x = -b. Return false when A is near singular, as for a flat or a straight cluster.
+    //
+    bool Minimize(LXtVector x) const
+    {
+        double c00 = a11 * a22 - a12 * a12;
+        double c01 = a02 * a12 - a01 * a22;
+        double c02 = a01 * a12 - a02 * a11;
+        double det = a00 * c00 + a01 * c01 + a02 * c02;
+        double tr  = a00 + a11 + a22;
+        if (tr <= 0.0 || std::fabs(det) < 1e-6 * tr * tr * tr)
+            return false;
+        double c11 = a00 * a22 - a02 * a02;
+        double c12 = a01 * a02 - a00 * a12;
+        double c22 = a00 * a11 - a01 * a01;
+        x[0] = -(c00 * b0 + c01 * b1 + c02 * b2) / det;
+        x[1] = -(c01 * b0 + c11 * b1 + c12 * b2) / det;
+        x[2] = -(c02 * b0 + c12 * b1 + c22 * b2) / det;
+        return true;
+    }
+};
+
+struct CVertexCluster
+{
+    // Clusters made per target vertex, leaving the collapse a few times the target to refine.
+    static constexpr double Factor = 4.0;
+
+    //
+    // Merge the vertices of each grid cell for about the given number of clusters. Only the
+    // vertices joined by the edges inside the cell are merged, so the two sides of a wall thinner
+    // than the cell stay apart. The locked vertices are never merged. The merges are resolved
+    // into the triangles. Return the number of merged vertices.
+    //
+    static unsigned Cluster(CMesh& cmesh, size_t nclusters, const std::vector<char>& locked, int threads)
+    {
+        size_t nvert = cmesh.m_vertices.size();
+        if (nvert == 0 || nclusters == 0 || nclusters * 2 > nvert)
+            return 0;
+
+        // Bounding box and surface area for the cell size.
+        LXtVector lo, hi;
+        LXx_VCPY(lo, cmesh.m_vertices[0]->pos);
+        LXx_VCPY(hi, cmesh.m_vertices[0]->pos);
+        for (auto& v : cmesh.m_vertices)
+        {
+            for (auto k = 0; k < 3; k++)
+            {
+                lo[k] = std::min(lo[k], v->pos[k]);
+                hi[k] = std::max(hi[k], v->pos[k]);
+            }
+        }
+        double area = 0.0;
+        for (auto& tri : cmesh.m_triangles)
+        {
+            if (tri->deleted)
+                continue;
+            LXtVector e1, e2, n;
+            LXx_VSUB3(e1, tri->v1->pos, tri->v0->pos);
+            LXx_VSUB3(e2, tri->v2->pos, tri->v0->pos);
+            LXx_VCROSS(n, e1, e2);
+            area += 0.5 * LXx_VLEN(n);
+        }
+        if (area <= 0.0)
+            return 0;
+
+        // A cell covers about its square of the surface.
+        double cell = std::sqrt(area / static_cast<double>(nclusters));
+        double span = std::max({ hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2] });
+        cell = std::max(cell, span / double(1u << 20));
+
+        // Cell and quadric of each vertex from its triangles weighted by their areas.
+        std::vector<uint64_t> cells(nvert);
+        std::vector<CQuadric> quadrics(nvert);
+        ThreadUtil::ParallelFor(nvert, threads, [&](size_t begin, size_t end) {
+            for (auto i = begin; i < end; i++)
+            {
+                auto& v = cmesh.m_vertices[i];
+                uint64_t ix = static_cast<uint64_t>((v->pos[0] - lo[0]) / cell);
+                uint64_t iy = static_cast<uint64_t>((v->pos[1] - lo[1]) / cell);
+                uint64_t iz = static_cast<uint64_t>((v->pos[2] - lo[2]) / cell);
+                cells[i] = ix | (iy << 21) | (iz << 42);
+                for (auto& tri : v->tris)
+                {
+                    if (tri->deleted)
+                        continue;
+                    LXtVector e1, e2, n;
+                    LXx_VSUB3(e1, tri->v1->pos, tri->v0->pos);
+                    LXx_VSUB3(e2, tri->v2->pos, tri->v0->pos);
+                    LXx_VCROSS(n, e1, e2);
+                    double len = LXx_VLEN(n);
+                    if (len <= 0.0)
+                        continue;
+                    LXx_VSCL(n, 1.0 / len);
+                    quadrics[i].AddPlane(n, -LXx_VDOT(n, tri->v0->pos), 0.5 * len);
+                }
+            }
+        });
+
+        // Join the unlocked vertices by the edges inside their cells. The smallest index
+        // represents the cluster.
+        std::vector<unsigned> leader(nvert);
+        for (auto i = 0u; i < nvert; i++)
+            leader[i] = i;
+        auto find = [&](unsigned i) {
+            while (leader[i] != i)
+                i = leader[i] = leader[leader[i]];
+            return i;
+        };
+        auto join = [&](const CVerxID& a, const CVerxID& b) {
+            if (locked[a->index] || locked[b->index] || cells[a->index] != cells[b->index])
+                return;
+            unsigned ra = find(a->index), rb = find(b->index);
+            if (ra != rb)
+                leader[std::max(ra, rb)] = std::min(ra, rb);
+        };
+        for (auto& tri : cmesh.m_triangles)
+        {
+            if (tri->deleted)
+                continue;
+            join(tri->v0, tri->v1);
+            join(tri->v1, tri->v2);
+            join(tri->v2, tri->v0);
+        }
+        for (auto i = 0u; i < nvert; i++)
+            leader[i] = find(i);
+
+        std::vector<unsigned> count(nvert, 0);
+        std::vector<double>   centroid(nvert * 3, 0.0);
+        for (auto i = 0u; i < nvert; i++)
+        {
+            unsigned r = leader[i];
+            count[r] ++;
+            LXx_VADD(&centroid[r * 3], cmesh.m_vertices[i]->pos);
+            if (r != i)
+                quadrics[r].Add(quadrics[i]);
+        }
+
+        // Place each cluster at the minimum of its quadric, or at its centroid when the
+        // minimum is undetermined or leaves the neighbourhood of the cell.
+        ThreadUtil::ParallelFor(nvert, threads, [&](size_t begin, size_t end) {
+            for (auto i = begin; i < end; i++)
+            {
+                if (leader[i] != i || count[i] < 2)
+                    continue;
+                LXtVector mean, x, d;
+                LXx_VCPY(mean, &centroid[i * 3]);
+                LXx_VSCL(mean, 1.0 / count[i]);
+                bool solved = quadrics[i].Minimize(x);
+                if (solved)
+                {
+                    LXx_VSUB3(d, x, mean);
+                    solved = LXx_VLEN(d) <= cell;
+                }
+                if (!solved)
+                    LXx_VCPY(x, mean);
+                auto& v = cmesh.m_vertices[i];
+                LXx_VCPY(v->new_pos, x);
+                v->moved = true;
+            }
+        });
+
+        unsigned merged = 0;
+        for (auto i = 0u; i < nvert; i++)
+        {
+            if (leader[i] != i)
+            {
+                cmesh.MergeVertex(i, leader[i]);
+                merged ++;
+            }
+        }
+        if (merged > 0)
+            cmesh.ResolveMerges();
+        return merged;
+    }
+};
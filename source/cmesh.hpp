@@ -12,23 +12,31 @@
 #include <lxsdk/lxu_matrix.hpp>
 #include <lxsdk/lxu_quaternion.hpp>
 
+#include <cstdint>
+#include <functional>
 #include <vector>
 #include <unordered_set>
 
 #include "util.hpp"
 #include "triangulate.hpp"
+#include "profile.hpp"
+#include "memory.hpp"
 
 struct CVerx;
-struct CEdge;
 struct CTriangle;
 struct CFace;
 struct CPart;
 
 typedef std::shared_ptr<CVerx>     CVerxID;
-typedef std::shared_ptr<CEdge>     CEdgeID;
 typedef std::shared_ptr<CTriangle> CTriangleID;
 typedef std::shared_ptr<CPart>     CPartID;
 
+// Containers of CMesh account their allocations into MP_CMesh pool.
+template <typename T>
+using CMeshAllocator = CountingAllocator<T, MP_CMesh>;
+template <typename T>
+using CMeshVector = std::vector<T, CMeshAllocator<T>>;
+
 struct CVerx
 {
     CTriangleID                 tri;
@@ -40,16 +48,9 @@ struct CVerx
     LXtVector                   new_pos;       // new vertex position
     void*                       userData;   // any working data
     LXtMarkMode                 marks;      // marks for working
-    std::vector<CEdgeID>        edge;       // connecting edges
-    std::vector<CTriangleID>    tris;       // connecting triangles
+    CMeshVector<CTriangleID>    tris;       // connecting triangles
     bool                        collapsed;  // vertex collapsed flag 
-};
-
-struct CEdge
-{
-    CVerxID                     v0, v1;  // vertex 1,2
-    std::vector<CTriangleID>    tris;       // connecting triangles
-    bool                        collapsed;  // edge collapsed flag
+    bool                        moved;      // new_pos differs from pos
 };
 
 struct CTriangle
@@ -60,7 +61,6 @@ struct CTriangle
     unsigned                    part;
     unsigned                    proxy;
     CVerxID                     v0, v1, v2;
-    CEdgeID                     edge;      // an edge
     bool                        deleted;   // triangle deleted flag
     bool                        updated;   // triangle updated flag
 };
@@ -68,15 +68,74 @@ struct CTriangle
 struct CFace
 {
     unsigned                    part;  // part index
-    std::vector<CTriangleID>    tris = {};  // triangles of the face
+    CMeshVector<CTriangleID>    tris = {};  // triangles of the face
 };
 
 struct CPart
 {
     unsigned                    index;
     bool                        no_source = false;
-    std::vector<CTriangleID>    tris = {};  // triangles of the part
-    std::vector<CVerxID>        vrts = {};  // vertices of the triangles
+    CMeshVector<CTriangleID>    tris = {};  // triangles of the part
+    CMeshVector<CVerxID>        vrts = {};  // vertices of the triangles
+};
+
+//
+// Number of elements written into the edit mesh by the last ApplyMesh, or into the new mesh
+// by the last WriteMesh.
+//
+struct CWriteStats
+{
+    unsigned added     = 0;     // vertices created
+    unsigned moved     = 0;     // vertices moved, or created away from their source by WriteMesh
+    unsigned removed   = 0;     // vertices removed
+    unsigned polygons  = 0;     // polygons rewritten or created
+    unsigned deleted   = 0;     // polygons removed
+    unsigned unchanged = 0;     // polygons kept as they are
+
+    void Clear()
+    {
+        *this = CWriteStats();
+    }
+
+    unsigned Total() const
+    {
+        return (added ? added : moved) + removed + polygons + deleted;
+    }
+};
+
+//
+// Changes of the decimation to be applied to an edit mesh. The points and polygons are referred
+// by their indices in the base mesh, so the result can be applied again to another instance of
+// the same mesh content.
+//
+struct CDecimateResult
+{
+    unsigned              npoints   = 0;    // point count of the base mesh
+    unsigned              npolygons = 0;    // polygon count of the base mesh
+    unsigned              unchanged = 0;    // polygons kept as they are
+    std::vector<unsigned> removed_points;   // points to remove
+    std::vector<unsigned> moved_points;     // points to move
+    std::vector<double>   positions;        // new x, y, z of the moved points
+    std::vector<unsigned> face_polys;       // polygons to set the vertex lists, removed by empty lists
+    std::vector<unsigned> face_starts;      // first of each vertex list in face_points and the end
+    std::vector<unsigned> face_points;      // points of the vertex lists
+    std::vector<unsigned> new_tris;         // points of the new triangles
+    std::vector<unsigned> new_tri_polys;    // source polygon of each new triangle for its tags
+    std::vector<unsigned> removed_polys;    // polygons to remove in triple mode
+
+    void Clear()
+    {
+        *this = CDecimateResult();
+    }
+
+    size_t Bytes() const
+    {
+        return sizeof(*this) +
+               sizeof(unsigned) * (removed_points.capacity() + moved_points.capacity() + face_polys.capacity() +
+                                   face_starts.capacity() + face_points.capacity() + new_tris.capacity() +
+                                   new_tri_polys.capacity() + removed_polys.capacity()) +
+               sizeof(double) * positions.capacity();
+    }
 };
 
 struct CMesh
@@ -100,7 +159,7 @@ struct CMesh
 
     LxResult AddTriangle(LXtPolygonID pol, LXtPointID v0, LXtPointID v1, LXtPointID v2)
     {
-        m_triangles.push_back(std::make_shared<CTriangle>());
+        m_triangles.push_back(std::allocate_shared<CTriangle>(CMeshAllocator<CTriangle>()));
         CTriangleID tri = m_triangles.back();
         tri->index = static_cast<int>(m_triangles.size()-1);
 
@@ -109,9 +168,6 @@ struct CMesh
         dv[1] = AddVertex(v1, pol, tri);
         dv[2] = AddVertex(v2, pol, tri);
 
-        CLxUser_Edge edge;
-        edge.fromMesh(m_mesh);
-
         if (pol)
         {
             CFace& face = m_faces[pol];
@@ -125,35 +181,6 @@ struct CMesh
         tri->updated = false;
         tri->deleted = false;
         tri->proxy = 0;
-
-        AddEdge(dv[0], dv[1], tri);
-        AddEdge(dv[1], dv[2], tri);
-        AddEdge(dv[2], dv[0], tri);
-        return LXe_OK;
-    }
-
-    LxResult AddEdge(CVerxID v0, CVerxID v1, CTriangleID tri)
-    {
-        // Check if the edge already exists
-        for (auto& edge : v0->edge)
-        {
-            if ((edge->v0 == v0 && edge->v1 == v1) || (edge->v0 == v1 && edge->v1 == v0))
-            {
-                edge->tris.push_back(tri);
-                return LXe_OK;
-            }
-        }
-
-        // Create a new edge
-        m_edges.push_back(std::make_shared<CEdge>());
-        CEdgeID edge = m_edges.back();
-        edge->v0 = v0;
-        edge->v1 = v1;
-        edge->collapsed = false;
-        edge->tris.push_back(tri);
-
-        v0->edge.push_back(edge);
-        v1->edge.push_back(edge);
         return LXe_OK;
     }
 
@@ -311,15 +338,23 @@ struct CMesh
             }
         }
 
-        m_vertices.push_back(std::make_shared<CVerx>());
+        CVerxID dv = NewVertex(vrt);
+        dv->tris.push_back(tri);
+        dv->tri = tri;
+        return dv;
+    }
+
+    // Append a new vertex of the given point with its position and point index.
+    CVerxID NewVertex(LXtPointID vrt)
+    {
+        m_vertices.push_back(std::allocate_shared<CVerx>(CMeshAllocator<CVerx>()));
         CVerxID dv = m_vertices.back();
 
-        dv->tris.push_back(tri);
         dv->vrt   = vrt;
-        dv->tri   = tri;
         dv->index = static_cast<unsigned>(m_vertices.size()-1);
         dv->marks = LXiMARK_ANY;
         dv->collapsed = false;
+        dv->moved = false;
         m_vert.Select(vrt);
         LXtFVector pos;
         m_vert.Pos(pos);
@@ -329,6 +364,171 @@ struct CMesh
         return dv;
     }
 
+    //
+    // Kind of the polygons in the base mesh for the fast paths of BuildMesh.
+    //
+    enum MeshKind
+    {
+        MK_Mixed = 0,   // generic path by TripleFaceVisitor
+        MK_Triangles,   // all polygons are triangles
+        MK_Quads        // all polygons are quads
+    };
+
+    //
+    // Classify the base mesh. The fast paths require that all polygons are selected, visible and
+    // unlocked surface polygons with the same vertex count of 3 or 4.
+    //
+    int MeshKindOf()
+    {
+        unsigned npol = 0, nvert0 = 0;
+        m_mesh.PolygonCount(&npol);
+        for (auto i = 0u; i < npol; i++)
+        {
+            m_poly.SelectByIndex(i);
+            if (m_poly.TestMarks(m_pick) != LXe_TRUE)
+                return MK_Mixed;
+            if (m_poly.TestMarks(m_mark_hide) == LXe_TRUE)
+                return MK_Mixed;
+            if (m_poly.TestMarks(m_mark_lock) == LXe_TRUE)
+                return MK_Mixed;
+            LXtID4 type;
+            m_poly.Type(&type);
+            if ((type != LXiPTYP_FACE) && (type != LXiPTYP_PSUB) && (type != LXiPTYP_SUBD))
+                return MK_Mixed;
+            unsigned nvert;
+            m_poly.VertexCount(&nvert);
+            if (i == 0)
+                nvert0 = nvert;
+            if ((nvert != nvert0) || (nvert < 3) || (nvert > 4))
+                return MK_Mixed;
+        }
+        if (nvert0 == 3)
+            return MK_Triangles;
+        if (nvert0 == 4)
+            return MK_Quads;
+        return MK_Mixed;
+    }
+
+    //
+    // Build the triangles of an all-triangle or all-quad mesh. The vertices are shared through
+    // a table indexed by the point index instead of tracing polygons around each point, and quads
+    // are split along the shorter diagonal which keeps both triangles inside. Note that a point
+    // pinched by separated polygon fans becomes one vertex here.
+    //
+    LxResult BuildHomogeneous(int kind, LXtMarkMode mark_clear)
+    {
+        unsigned npol = 0, npnt = 0;
+        m_mesh.PolygonCount(&npol);
+        m_mesh.PointCount(&npnt);
+
+        m_triangles.reserve((kind == MK_Quads) ? npol * 2 : npol);
+        m_vertices.reserve(npnt);
+        m_faces.reserve(npol);
+
+        static const unsigned none = ~0u;
+        CMeshVector<unsigned> table(npnt, none);
+
+        CVerxID dv[4];
+        for (auto i = 0u; i < npol; i++)
+        {
+            if (Stopped("triangulate"))
+                return LXe_ABORT;
+            m_poly.SelectByIndex(i);
+            m_poly.SetMarks(mark_clear);
+            LXtPolygonID pol = m_poly.ID();
+            CFace& face = m_faces[pol];
+            face.tris.reserve((kind == MK_Quads) ? 2 : 1);
+
+            unsigned nvert = (kind == MK_Quads) ? 4 : 3;
+            for (auto j = 0u; j < nvert; j++)
+            {
+                LXtPointID vrt;
+                unsigned   index;
+                m_poly.VertexByIndex(j, &vrt);
+                m_vert.Select(vrt);
+                m_vert.Index(&index);
+                if (table[index] == none)
+                {
+                    dv[j] = NewVertex(vrt);
+                    table[index] = dv[j]->index;
+                }
+                else
+                    dv[j] = m_vertices[table[index]];
+            }
+
+            if (kind == MK_Triangles)
+            {
+                AddTriangle(face, pol, dv[0], dv[1], dv[2]);
+            }
+            else if (QuadSplitDiagonal(dv) == 0)
+            {
+                AddTriangle(face, pol, dv[0], dv[1], dv[2]);
+                AddTriangle(face, pol, dv[0], dv[2], dv[3]);
+            }
+            else
+            {
+                AddTriangle(face, pol, dv[1], dv[2], dv[3]);
+                AddTriangle(face, pol, dv[1], dv[3], dv[0]);
+            }
+        }
+        m_triStats.simple += npol;
+        return LXe_OK;
+    }
+
+    //
+    // Return 0 to split the quad along v0-v2, or 1 to split along v1-v3. The shorter diagonal
+    // is taken when both splits keep the triangles facing the same direction.
+    //
+    static unsigned QuadSplitDiagonal(const CVerxID dv[4])
+    {
+        bool     valid[2];
+        double   length[2];
+        for (auto k = 0u; k < 2; k++)
+        {
+            const double* p0 = dv[k]->pos;
+            const double* p1 = dv[k + 1]->pos;
+            const double* p2 = dv[k + 2]->pos;
+            const double* p3 = dv[(k + 3) % 4]->pos;
+            LXtVector e1, e2, e3, n0, n1;
+            LXx_VSUB3(e1, p1, p0);
+            LXx_VSUB3(e2, p2, p0);
+            LXx_VSUB3(e3, p3, p0);
+            LXx_VCROSS(n0, e1, e2);
+            LXx_VCROSS(n1, e2, e3);
+            valid[k]  = LXx_VDOT(n0, n1) > 0.0;
+            length[k] = LXx_VDOT(e2, e2);
+        }
+        if (valid[0] && valid[1])
+            return (length[1] < length[0]) ? 1 : 0;
+        return valid[1] ? 1 : 0;
+    }
+
+    //
+    // Add a triangle of the existing vertices into the face.
+    //
+    LxResult AddTriangle(CFace& face, LXtPolygonID pol, const CVerxID& v0, const CVerxID& v1, const CVerxID& v2)
+    {
+        m_triangles.push_back(std::allocate_shared<CTriangle>(CMeshAllocator<CTriangle>()));
+        CTriangleID& tri = m_triangles.back();
+        tri->index = static_cast<unsigned>(m_triangles.size()-1);
+        tri->v0   = v0;
+        tri->v1   = v1;
+        tri->v2   = v2;
+        tri->pol  = pol;
+        tri->updated = false;
+        tri->deleted = false;
+        tri->proxy = 0;
+
+        for (auto* dv : { &v0, &v1, &v2 })
+        {
+            (*dv)->tris.push_back(tri);
+            if (!(*dv)->tri)
+                (*dv)->tri = tri;
+        }
+        face.tris.push_back(tri);
+        return LXe_OK;
+    }
+
     // Visitor to build triangles from polygons
     //
     class TripleFaceVisitor : public CLxImpl_AbstractVisitor
@@ -336,6 +536,9 @@ struct CMesh
     public:
         LxResult Evaluate()
         {
+            if (m_context->Stopped("triangulate"))
+                return LXe_ABORT;
+
             unsigned nvert;
             m_poly.VertexCount(&nvert);
             if (nvert < 3)
@@ -359,6 +562,7 @@ struct CMesh
                 m_poly.VertexByIndex(1, &v1);
                 m_poly.VertexByIndex(2, &v2);
                 m_context->AddTriangle(m_poly.ID(), v0, v1, v2);
+                m_context->m_triStats.simple ++;
             }
             else if (MeshUtil::PolygonFixedVertexList(m_mesh, m_poly, points))
             {
@@ -372,7 +576,16 @@ struct CMesh
                     std::vector<std::vector<LXtPointID>> tris;
                     CTriangulate ctri(m_mesh);
                     LxResult result = LXe_OK;
-                    result = ctri.ConstraintDelaunay(axisPlane, points, tris);
+                    if (ctri.ConvexFan(axisPlane, points, tris))
+                    {
+                        m_context->m_triStats.convex ++;
+                        PROFILE_COUNT(PC_ConvexPolygons, 1);
+                    }
+                    else
+                    {
+                        result = ctri.ConstraintDelaunay(axisPlane, points, tris);
+                        m_context->m_triStats.cdt ++;
+                    }
                     if (result == LXe_OK)
                     {
                         for (auto& vert : tris)
@@ -381,7 +594,30 @@ struct CMesh
                         }
                         done = true;
                     }
+                    else
+                    {
+                        // Ear clipping keeps the triangles inside of the polygon boundary
+                        // unlike the simple fan below.
+                        PROFILE_COUNT(PC_CDTFallbacks, 1);
+                        tris.clear();
+                        if (ctri.EarClipping(axisPlane, points, tris) == LXe_OK)
+                        {
+                            for (auto& vert : tris)
+                            {
+                                m_context->AddTriangle(m_poly.ID(), vert[0], vert[1], vert[2]);
+                            }
+                            m_context->m_triStats.fallback ++;
+                            done = true;
+                        }
+                        else
+                        {
+                            m_context->m_triStats.failed ++;
+                            PROFILE_COUNT(PC_FanFallbacks, 1);
+                        }
+                    }
                 }
+                else
+                    m_context->m_triStats.simple ++;
                 if (!done)
                 {
                     v0 = points[0];
@@ -396,6 +632,7 @@ struct CMesh
             else
             {
                 unsigned count;
+                m_context->m_triStats.generated ++;
                 m_poly.GenerateTriangles(&count);
                 for (auto i = 0u; i < count; i++)
                 {
@@ -418,6 +655,9 @@ struct CMesh
     public:
         LxResult Evaluate()
         {
+            if (m_context->Stopped("parts"))
+                return LXe_ABORT;
+
             CLxUser_LogService   s_log;
             unsigned nvert;
             m_poly.VertexCount(&nvert);
@@ -432,7 +672,7 @@ struct CMesh
             if (m_poly.TestMarks(m_mark_done) == LXe_TRUE)
                 return LXe_OK;
 
-            m_context->m_parts.push_back(std::make_shared<CPart>());
+            m_context->m_parts.push_back(std::allocate_shared<CPart>(CMeshAllocator<CPart>()));
             CPartID part = m_context->m_parts.back();
 
             part->index = static_cast<unsigned>(m_context->m_parts.size() - 1);
@@ -484,6 +724,8 @@ struct CMesh
                             continue;
                         if (poly1.TestMarks(m_context->m_mark_lock) == LXe_TRUE)
                             continue;
+                        if (m_built && m_context->m_faces.find(pol1) == m_context->m_faces.end())
+                            continue;
                         stack.push_back(pol1);
                     }
                 }
@@ -497,181 +739,387 @@ struct CMesh
         CLxUser_Point   m_vert;
         LXtMarkMode     m_mark_done;
         struct CMesh*   m_context;
+        bool            m_built = false;    // walk only into the polygons built into the faces
     };
 
     //
-    // Build internal mesh representation
+    // Build internal mesh representation of the selected polygons, or of the listed polygons
+    // by index, whose parts do not extend to the other polygons.
     //
-    LxResult BuildMesh(CLxUser_Mesh& base_mesh)
+    LxResult BuildMesh(CLxUser_Mesh& base_mesh, const std::vector<unsigned>* polys = nullptr)
     {
         CLxUser_MeshService mesh_svc;
         TripleFaceVisitor triFace;
 
+        Clear();
+
         m_mesh.set(base_mesh);
         m_poly.fromMesh(m_mesh);
         m_vert.fromMesh(m_mesh);
         m_vmap.fromMesh(m_mesh);
+        if (polys)
+            m_npolygons = static_cast<unsigned>(polys->size());
+        else
+            m_mesh.PolygonCount(&m_npolygons);
+        m_visited = 0;
+        m_stopped = false;
+
+        // Visit the listed polygons which are selected, or enumerate the selected ones.
+        auto visit = [&](CLxImpl_AbstractVisitor& visitor, CLxUser_Polygon& poly) {
+            if (!polys)
+            {
+                poly.Enum(&visitor, m_pick);
+                return;
+            }
+            for (auto i : *polys)
+            {
+                poly.SelectByIndex(i);
+                if (poly.TestMarks(m_pick) == LXe_TRUE && visitor.Evaluate() != LXe_OK)
+                    break;
+            }
+        };
 
         // triagulate surface polygons.
-        triFace.m_mesh = m_mesh;
-        triFace.m_poly.fromMesh(m_mesh);
-        triFace.m_vert.fromMesh(m_mesh);
-        triFace.m_mark_done = mesh_svc.ClearMode(LXsMARK_USER_0);
-        triFace.m_context = this;
-        triFace.m_poly.Enum(&triFace, m_pick);
+        CStopwatch watch;
+        int kind = polys ? MK_Mixed : MeshKindOf();
+        if (kind != MK_Mixed)
+        {
+            BuildHomogeneous(kind, mesh_svc.ClearMode(LXsMARK_USER_0));
+        }
+        else
+        {
+            triFace.m_mesh = m_mesh;
+            triFace.m_poly.fromMesh(m_mesh);
+            triFace.m_vert.fromMesh(m_mesh);
+            triFace.m_mark_done = mesh_svc.ClearMode(LXsMARK_USER_0);
+            triFace.m_context = this;
+            visit(triFace, triFace.m_poly);
+        }
+        m_times.triangulate = watch.Elapsed();
+        PROFILE_PHASE("triangulate", watch);
+        if (m_stopped)
+            return LXe_ABORT;
 
         // divides polygons into parts.
+        watch.Reset();
+        m_visited = 0;
         PartFaceVisitor partFace;
         partFace.m_mesh = m_mesh;
         partFace.m_poly.fromMesh(m_mesh);
         partFace.m_vert.fromMesh(m_mesh);
         partFace.m_mark_done = mesh_svc.SetMode(LXsMARK_USER_0);
         partFace.m_context = this;
-        partFace.m_poly.Enum(&partFace, m_pick);
+        partFace.m_built = polys != nullptr;
+        visit(partFace, partFace.m_poly);
+        if (m_stopped)
+            return LXe_ABORT;
 
         for (auto& v : m_vertices)
         {
             m_parts[v->part]->vrts.push_back(v);
         }
-        printf("Build mesh with %zu vertices %zu triangles %zu parts\n", m_vertices.size(), m_triangles.size(), m_parts.size());
+        m_times.parts = watch.Elapsed();
+        PROFILE_PHASE("parts", watch);
+
+        if (m_spatialOrder)
+        {
+            watch.Reset();
+            SpatialReorder();
+            m_times.reorder = watch.Elapsed();
+            PROFILE_PHASE("reorder", watch);
+        }
+
+        PROFILE_COUNT(PC_Polygons, m_faces.size());
+        PROFILE_COUNT(PC_Triangles, m_triangles.size());
+        PROFILE_COUNT(PC_Vertices, m_vertices.size());
+        PROFILE_COUNT(PC_Parts, m_parts.size());
         return LXe_OK;
     }
 
     //
-    // Write internal mesh representation back to edit mesh
+    // Report the progress of the phase of BuildMesh once per batch of polygons. Return true
+    // when the progress callback stopped the build.
     //
-    LxResult WriteMesh(CLxUser_Mesh& out_mesh)
+    bool Stopped(const char* phase)
+    {
+        static const unsigned Batch = 4096;
+        if (m_stopped || !m_progress)
+            return m_stopped;
+        if ((m_visited++ % Batch) == 0)
+            m_stopped = !m_progress(phase, m_npolygons ? static_cast<double>(m_visited - 1) / m_npolygons : 0.0);
+        return m_stopped;
+    }
+
+    //
+    // Sort the vertices by the Morton codes of their positions and the triangles by the codes of
+    // their centroids, and renumber them. The polygon enumeration order is often spatially random
+    // for imported meshes, and the Surface_mesh built in this order keeps the neighbours of each
+    // vertex close in memory for the collapse.
+    //
+    void SpatialReorder()
     {
-        //printf("Writing mesh with %zu vertices and %zu triangles\n", m_vertices.size(), m_triangles.size());
-        std::vector<LXtPointID> point_ids(m_vertices.size());
-        m_vert.fromMesh(out_mesh);
+        size_t nvert = m_vertices.size();
+        size_t ntri  = m_triangles.size();
+        if (nvert == 0)
+            return;
+
+        double lo[3], hi[3];
+        LXx_VCPY(lo, m_vertices[0]->pos);
+        LXx_VCPY(hi, m_vertices[0]->pos);
         for (auto& v : m_vertices)
         {
-            if (v->collapsed)
-                point_ids[v->index] = nullptr;
-            else
+            for (auto k = 0; k < 3; k++)
             {
-                LXtPointID new_vrt;
-                LXtVector pos;
-                LXx_VCPY(pos, v->new_pos);
-                m_vert.New(pos, &new_vrt);
-                point_ids[v->index] = new_vrt;
+                lo[k] = std::min(lo[k], v->pos[k]);
+                hi[k] = std::max(hi[k], v->pos[k]);
             }
         }
-        m_poly.fromMesh(out_mesh);
 
-        for (auto& tri : m_triangles)
+        std::vector<std::pair<uint64_t, unsigned>> vorder(nvert), torder(ntri);
+        ThreadUtil::ParallelFor(nvert, m_threads, [&](size_t begin, size_t end) {
+            for (auto i = begin; i < end; i++)
+                vorder[i] = { MathUtil::MortonCode(m_vertices[i]->pos, lo, hi), static_cast<unsigned>(i) };
+        });
+        ThreadUtil::ParallelFor(ntri, m_threads, [&](size_t begin, size_t end) {
+            for (auto i = begin; i < end; i++)
+            {
+                auto&     tri = m_triangles[i];
+                LXtVector c;
+                for (auto k = 0; k < 3; k++)
+                    c[k] = (tri->v0->pos[k] + tri->v1->pos[k] + tri->v2->pos[k]) / 3.0;
+                torder[i] = { MathUtil::MortonCode(c, lo, hi), static_cast<unsigned>(i) };
+            }
+        });
+        std::sort(vorder.begin(), vorder.end());
+        std::sort(torder.begin(), torder.end());
+
+        CMeshVector<CVerxID> vertices(nvert);
+        for (auto i = 0u; i < nvert; i++)
         {
-            if (tri->deleted)
-                continue;
+            vertices[i] = m_vertices[vorder[i].second];
+            vertices[i]->index = i;
+        }
+        m_vertices.swap(vertices);
 
-            unsigned int rev = 0;
-            LXtPointID points[3];
-            points[0] = point_ids[tri->v0->index];
-            points[1] = point_ids[tri->v1->index];
-            points[2] = point_ids[tri->v2->index];
+        CMeshVector<CTriangleID> triangles(ntri);
+        for (auto i = 0u; i < ntri; i++)
+        {
+            triangles[i] = m_triangles[torder[i].second];
+            triangles[i]->index = i;
+        }
+        m_triangles.swap(triangles);
+    }
 
-            LXtPolygonID new_pol;
-            m_poly.New(LXiPTYP_FACE, points, 3, rev, &new_pol);
+    //
+    // Export the triangulated topology: the point index of each vertex, and the vertex indices
+    // and the source polygon index of each triangle.
+    //
+    LxResult ExportTopology(std::vector<uint32_t>& verts, std::vector<uint32_t>& tris)
+    {
+        verts.resize(m_vertices.size());
+        for (auto& v : m_vertices)
+            verts[v->index] = v->vrt_index;
+
+        tris.resize(m_triangles.size() * 4);
+        for (auto& tri : m_triangles)
+        {
+            uint32_t* t = &tris[tri->index * 4];
+            t[0] = tri->v0->index;
+            t[1] = tri->v1->index;
+            t[2] = tri->v2->index;
+            t[3] = ~0u;
+            if (tri->pol)
+            {
+                m_poly.Select(tri->pol);
+                m_poly.Index(&t[3]);
+            }
         }
         return LXe_OK;
     }
 
-    CEdgeID FetchEdge(CVerxID v0, CVerxID v1)
+    //
+    // Build the internal mesh from the topology exported by ExportTopology() of the same base
+    // mesh instead of triangulating the polygons. The parts are not built.
+    //
+    LxResult BuildFromTopology(CLxUser_Mesh& base_mesh, const uint32_t* verts, unsigned nverts, const uint32_t* tris, unsigned ntris)
     {
-        for (auto& edge : v0->edge)
+        CLxUser_MeshService mesh_svc;
+        LXtMarkMode mark_clear = mesh_svc.ClearMode(LXsMARK_USER_0);
+
+        Clear();
+
+        m_mesh.set(base_mesh);
+        m_poly.fromMesh(m_mesh);
+        m_vert.fromMesh(m_mesh);
+        m_vmap.fromMesh(m_mesh);
+
+        CStopwatch watch;
+        unsigned npnt = 0, npol = 0;
+        m_mesh.PointCount(&npnt);
+        m_mesh.PolygonCount(&npol);
+
+        m_vertices.reserve(nverts);
+        m_triangles.reserve(ntris);
+        for (auto i = 0u; i < nverts; i++)
+        {
+            if (verts[i] >= npnt)
+                return LXe_FAILED;
+            m_vert.SelectByIndex(verts[i]);
+            NewVertex(m_vert.ID());
+        }
+
+        CFace none;
+        for (auto i = 0u; i < ntris; i++)
         {
-            if ((edge->v0 == v0 && edge->v1 == v1) || (edge->v0 == v1 && edge->v1 == v0))
+            const uint32_t* t = &tris[i * 4];
+            if (t[0] >= nverts || t[1] >= nverts || t[2] >= nverts)
+                return LXe_FAILED;
+            LXtPolygonID pol = nullptr;
+            if (t[3] < npol)
             {
-                return edge;
+                m_poly.SelectByIndex(t[3]);
+                m_poly.SetMarks(mark_clear);
+                pol = m_poly.ID();
             }
+            CFace& face = pol ? m_faces[pol] : none;
+            AddTriangle(face, pol, m_vertices[t[0]], m_vertices[t[1]], m_vertices[t[2]]);
         }
-        return nullptr;
+        m_times.triangulate = watch.Elapsed();
+        PROFILE_PHASE("triangulate", watch);
+
+        PROFILE_COUNT(PC_Polygons, m_faces.size());
+        PROFILE_COUNT(PC_Triangles, m_triangles.size());
+        PROFILE_COUNT(PC_Vertices, m_vertices.size());
+        return LXe_OK;
     }
 
     //
-    // Collapse the edge given by vertex end indices. Merge v1 to v0 when forward is true,
-    // otherwise merge v0 to v1.
+    // Write internal mesh representation back to edit mesh. The surviving vertices and triangles
+    // are packed into compact buffers first and then emitted in one pass.
     //
-    LxResult CollapseEdge(int verx0_index, int verx1_index, bool forward)
+    LxResult WriteMesh(CLxUser_Mesh& out_mesh)
     {
-        CVerxID v0 = m_vertices[verx0_index];
-        CVerxID v1 = m_vertices[verx1_index];
+        CStopwatch watch;
+        m_written.Clear();
 
-        CEdgeID target_edge = FetchEdge(v0, v1);
-        if (!target_edge)
-            return LXe_FAILED;
-
-        if (forward)
+        // Prepare the compact position and index buffers of the surviving elements.
+        std::vector<double>   positions;
+        std::vector<unsigned> remap(m_vertices.size(), 0);
+        std::vector<unsigned> indices;
         {
-            // Collapse v1 into v0
-            for (auto& tri : v1->tris)
+            PROFILE_SCOPE("writeback.prepare");
+            positions.reserve(m_vertices.size() * 3);
+            for (auto& v : m_vertices)
             {
-                if (tri->v0 == v1)
-                    tri->v0 = v0;
-                if (tri->v1 == v1)
-                    tri->v1 = v0;
-                if (tri->v2 == v1)
-                    tri->v2 = v0;
-                tri->updated = true;
-                v0->tris.push_back(tri);
+                if (v->collapsed)
+                    continue;
+                if (v->moved)
+                    m_written.moved ++;
+                remap[v->index] = static_cast<unsigned>(positions.size() / 3);
+                positions.insert(positions.end(), { v->new_pos[0], v->new_pos[1], v->new_pos[2] });
             }
-            for (auto& edge : v1->edge)
+            indices.reserve(m_triangles.size() * 3);
+            for (auto& tri : m_triangles)
             {
-                if (edge->v0 == v1)
-                    edge->v0 = v0;
-                if (edge->v1 == v1)
-                    edge->v1 = v0;
-                CEdgeID edge1 = FetchEdge(edge->v0, edge->v1);
-                if (edge1 != nullptr && edge1 != edge)
-                    edge->collapsed = true;
-                else
-                    v0->edge.push_back(edge);
+                if (tri->deleted)
+                    continue;
+                indices.insert(indices.end(), { remap[tri->v0->index], remap[tri->v1->index], remap[tri->v2->index] });
             }
-            v1->collapsed = true;
         }
-        else
+
+        // Emit the buffers into the mesh.
         {
-            // Collapse v0 into v1
-            for (auto& tri : v0->tris)
+            PROFILE_SCOPE("writeback.emit");
+            auto nvert = positions.size() / 3;
+            std::vector<LXtPointID> point_ids(nvert);
+            m_vert.fromMesh(out_mesh);
+            for (auto i = 0u; i < nvert; i++)
             {
-                if (tri->v0 == v0)
-                    tri->v0 = v1;
-                if (tri->v1 == v0)
-                    tri->v1 = v1;
-                if (tri->v2 == v0)
-                    tri->v2 = v1;
-                tri->updated = true;
-                v1->tris.push_back(tri);
+                m_vert.New(&positions[i * 3], &point_ids[i]);
             }
-            for (auto& edge : v0->edge)
+            m_poly.fromMesh(out_mesh);
+
+            unsigned int rev = 0;
+            LXtPointID   points[3];
+            LXtPolygonID new_pol;
+            for (auto i = 0u; i < indices.size(); i += 3)
             {
-                if (edge->v0 == v0)
-                    edge->v0 = v1;
-                if (edge->v1 == v0)
-                    edge->v1 = v1;
-                CEdgeID edge1 = FetchEdge(edge->v0, edge->v1);
-                if (edge1 != nullptr && edge1 != edge)
-                    edge->collapsed = true;
-                else
-                    v1->edge.push_back(edge);
+                points[0] = point_ids[indices[i + 0]];
+                points[1] = point_ids[indices[i + 1]];
+                points[2] = point_ids[indices[i + 2]];
+                m_poly.New(LXiPTYP_FACE, points, 3, rev, &new_pol);
             }
-            v0->collapsed = true;
+            m_written.added    = static_cast<unsigned>(nvert);
+            m_written.polygons = static_cast<unsigned>(indices.size() / 3);
         }
-        target_edge->collapsed = true;
-        for (auto& tri : target_edge->tris)
+        m_times.writeback = watch.Elapsed();
+        PROFILE_PHASE("writeback", watch);
+        return LXe_OK;
+    }
+
+    //
+    // Record the merge of the vertex 'from' into the vertex 'to' given by vertex indices. The
+    // triangles are updated by ResolveMerges().
+    //
+    void MergeVertex(unsigned from, unsigned to)
+    {
+        if (m_merge.size() != m_vertices.size())
         {
-            tri->deleted = true;
-            if (forward)
-            {
-                v1->tris.erase(std::remove(v1->tris.begin(), v1->tris.end(), tri), v1->tris.end());
-            }
-            else
+            m_merge.resize(m_vertices.size());
+            for (auto i = 0u; i < m_merge.size(); i++)
+                m_merge[i] = i;
+        }
+        m_merge[from] = to;
+    }
+
+    // Get the surviving vertex index of the given vertex index.
+    unsigned FindVertex(unsigned index)
+    {
+        while (m_merge[index] != index)
+        {
+            m_merge[index] = m_merge[m_merge[index]];
+            index = m_merge[index];
+        }
+        return index;
+    }
+
+    //
+    // Redirect the triangle corners to the surviving vertices of the recorded merges, and delete
+    // the triangles degenerated by the merges. This is linear in the number of triangles. The
+    // surviving vertex index of each vertex is kept in m_survivor, following the survivors of
+    // the previous resolution when the merges are resolved in stages.
+    //
+    LxResult ResolveMerges()
+    {
+        if (m_merge.empty())
+            return LXe_OK;
+
+        bool staged = m_survivor.size() == m_vertices.size();
+        m_survivor.resize(m_vertices.size());
+        for (auto& v : m_vertices)
+        {
+            m_survivor[v->index] = FindVertex(staged ? m_survivor[v->index] : v->index);
+            if (m_survivor[v->index] != v->index)
+                v->collapsed = true;
+        }
+        for (auto& tri : m_triangles)
+        {
+            if (tri->deleted)
+                continue;
+            CVerxID& v0 = m_vertices[m_survivor[tri->v0->index]];
+            CVerxID& v1 = m_vertices[m_survivor[tri->v1->index]];
+            CVerxID& v2 = m_vertices[m_survivor[tri->v2->index]];
+            if (v0 != tri->v0 || v1 != tri->v1 || v2 != tri->v2)
             {
-                v0->tris.erase(std::remove(v0->tris.begin(), v0->tris.end(), tri), v0->tris.end());
+                tri->v0 = v0;
+                tri->v1 = v1;
+                tri->v2 = v2;
+                tri->updated = true;
             }
-            tri->deleted = true;
+            if (v0 == v1 || v1 == v2 || v2 == v0)
+                tri->deleted = true;
         }
+        m_merge.clear();
         return LXe_OK;
     }
 
@@ -679,67 +1127,229 @@ struct CMesh
     // Apply the triangle mesh into the give edit mesh. The edit mesh must be an instanced mesh from
     // the base mesh used for BuildMesh(). This function uses the source polygons as possible when 
     // are not updated. And it also reuses existing vertices from base mesh as possible.
+    // Only the elements changed by the decimation are written, and they are counted in m_written.
     //
     LxResult ApplyMesh(CLxUser_Mesh& edit_mesh, bool triple)
     {
-        m_mesh.set(edit_mesh);
-        m_poly.fromMesh(m_mesh);
-        m_vert.fromMesh(m_mesh);
-        m_vmap.fromMesh(m_mesh);
+        CStopwatch watch;
+        {
+            PROFILE_SCOPE("writeback.prepare");
+            MakeResult(triple, m_result);
+        }
+        ApplyResult(edit_mesh, m_result);
+        m_times.writeback = watch.Elapsed();
+        PROFILE_PHASE("writeback", watch);
+        return LXe_OK;
+    }
+
+    //
+    // Make the changes of the decimation by the point and polygon indices of the base mesh.
+    // This must be called before the mesh is switched to the edit mesh.
+    //
+    LxResult MakeResult(bool triple, CDecimateResult& result)
+    {
+        result.Clear();
+        m_mesh.PointCount(&result.npoints);
+        m_mesh.PolygonCount(&result.npolygons);
 
-        printf("ApplyMesh mesh with %zu vertices and %zu triangles\n", m_vertices.size(), m_triangles.size());
+        // Only the vertices collapsed or moved by the decimation are touched.
         for (auto& v : m_vertices)
         {
-            m_vert.Select(v->vrt);
             if (v->collapsed)
-                m_vert.Remove();
-            else
-                m_vert.SetPos(v->new_pos);
+                result.removed_points.push_back(v->vrt_index);
+            else if (v->moved)
+            {
+                result.moved_points.push_back(v->vrt_index);
+                result.positions.insert(result.positions.end(), { v->new_pos[0], v->new_pos[1], v->new_pos[2] });
+            }
         }
 
+        CLxUser_Polygon poly;
+        poly.fromMesh(m_mesh);
+        auto polygon_index = [&](LXtPolygonID pol) {
+            unsigned index;
+            poly.Select(pol);
+            poly.Index(&index);
+            return index;
+        };
+
         if (triple)
         {
-            for (auto& tri : m_triangles)
-            {
-                if (tri->deleted)
-                    continue;
-
-                unsigned int rev = 0;
-                LXtPointID point_ids[3];
-                point_ids[0] = tri->v0->vrt;
-                point_ids[1] = tri->v1->vrt;
-                point_ids[2] = tri->v2->vrt;
-
-                LXtPolygonID new_pol;
-                m_poly.NewProto(LXiPTYP_FACE, point_ids, 3, rev, &new_pol);
-            }
+            // Source triangles which are not updated are kept, the other faces are replaced
+            // with their triangles.
+            result.new_tris.reserve(m_triangles.size() * 3);
             for (auto& face : m_faces)
             {
-                m_poly.Select(face.first);
-                m_poly.Remove();
+                if (face.second.tris.size() == 1 && !FaceIsUpdated(face.second))
+                {
+                    result.unchanged ++;
+                    continue;
+                }
+                unsigned index = polygon_index(face.first);
+                for (auto& tri : face.second.tris)
+                {
+                    if (tri->deleted)
+                        continue;
+                    result.new_tris.insert(result.new_tris.end(), { tri->v0->vrt_index, tri->v1->vrt_index, tri->v2->vrt_index });
+                    result.new_tri_polys.push_back(index);
+                }
+                result.removed_polys.push_back(index);
             }
         }
         else
         {
+            // The vertex lists of the updated faces are made on worker threads.
+            std::vector<std::pair<LXtPolygonID,CFace*>> updated;
             for (auto& face : m_faces)
             {
-                unsigned int rev = 0;
-                std::vector<LXtPointID> points = {};
-                GetPointsFromFace(face.second, points);
-                m_poly.Select(face.first);
-                if (points.size() < 3)
-                    m_poly.Remove();
-
-                else if (FaceIsUpdated(face.second) == true)
+                if (FaceIsUpdated(face.second) == false)
+                    result.unchanged ++;
+                else
+                    updated.push_back(std::make_pair(face.first, &face.second));
+            }
+            std::unordered_map<LXtPointID,unsigned> point_index;
+            if (!updated.empty())
+            {
+                point_index.reserve(m_vertices.size());
+                for (auto& v : m_vertices)
+                    point_index[v->vrt] = v->vrt_index;
+            }
+            std::vector<std::vector<LXtPointID>> face_points(updated.size());
+            std::vector<char>                    split(updated.size(), 0);
+            ThreadUtil::ParallelFor(updated.size(), m_threads, [&](size_t begin, size_t end) {
+                for (auto i = begin; i < end; i++)
+                    split[i] = GetPointsFromFace(*updated[i].second, face_points[i]) != LXe_OK;
+            });
+            result.face_starts.push_back(0);
+            for (auto i = 0u; i < updated.size(); i++)
+            {
+                unsigned index = polygon_index(updated[i].first);
+                result.face_polys.push_back(index);
+                if (split[i])
                 {
-                    m_poly.SetMarks(m_mark_done);
-                    m_poly.SetVertexList(points.data(), static_cast<unsigned>(points.size()), rev);
+                    // The face keeps its first triangle and the others are new polygons of it.
+                    bool first = true;
+                    for (auto& tri : updated[i].second->tris)
+                    {
+                        if (tri->deleted)
+                            continue;
+                        auto& list = first ? result.face_points : result.new_tris;
+                        list.insert(list.end(), { tri->v0->vrt_index, tri->v1->vrt_index, tri->v2->vrt_index });
+                        if (!first)
+                            result.new_tri_polys.push_back(index);
+                        first = false;
+                    }
                 }
+                else if (face_points[i].size() >= 3)
+                {
+                    for (auto vrt : face_points[i])
+                        result.face_points.push_back(point_index[vrt]);
+                }
+                result.face_starts.push_back(static_cast<unsigned>(result.face_points.size()));
             }
         }
         return LXe_OK;
     }
 
+    //
+    // Apply the changes into the edit mesh. All indices are resolved into the elements before
+    // any change, since removing elements may shift the indices.
+    //
+    LxResult ApplyResult(CLxUser_Mesh& edit_mesh, const CDecimateResult& result)
+    {
+        PROFILE_SCOPE("writeback.emit");
+        m_mesh.set(edit_mesh);
+        m_poly.fromMesh(m_mesh);
+        m_vert.fromMesh(m_mesh);
+        m_vmap.fromMesh(m_mesh);
+
+        m_written.Clear();
+        m_written.unchanged = result.unchanged;
+
+        unsigned npnt = 0, npol = 0;
+        m_mesh.PointCount(&npnt);
+        m_mesh.PolygonCount(&npol);
+        if (npnt != result.npoints || npol != result.npolygons)
+            return LXe_FAILED;
+
+        auto points = [&](const std::vector<unsigned>& indices, std::vector<LXtPointID>& ids) {
+            ids.resize(indices.size());
+            for (auto i = 0u; i < indices.size(); i++)
+            {
+                m_vert.SelectByIndex(indices[i]);
+                ids[i] = m_vert.ID();
+            }
+        };
+        auto polygons = [&](const std::vector<unsigned>& indices, std::vector<LXtPolygonID>& ids) {
+            ids.resize(indices.size());
+            for (auto i = 0u; i < indices.size(); i++)
+            {
+                m_poly.SelectByIndex(indices[i]);
+                ids[i] = m_poly.ID();
+            }
+        };
+
+        std::vector<LXtPointID>   removed_points, moved_points, face_points, new_tris;
+        std::vector<LXtPolygonID> face_polys, removed_polys, new_tri_polys;
+        points(result.removed_points, removed_points);
+        points(result.moved_points, moved_points);
+        points(result.face_points, face_points);
+        points(result.new_tris, new_tris);
+        polygons(result.face_polys, face_polys);
+        polygons(result.removed_polys, removed_polys);
+        polygons(result.new_tri_polys, new_tri_polys);
+
+        for (auto vrt : removed_points)
+        {
+            m_vert.Select(vrt);
+            m_vert.Remove();
+        }
+        for (auto i = 0u; i < moved_points.size(); i++)
+        {
+            m_vert.Select(moved_points[i]);
+            m_vert.SetPos(&result.positions[i * 3]);
+        }
+        m_written.removed = static_cast<unsigned>(removed_points.size());
+        m_written.moved   = static_cast<unsigned>(moved_points.size());
+
+        unsigned int rev = 0;
+        for (auto i = 0u; i < face_polys.size(); i++)
+        {
+            unsigned first = result.face_starts[i];
+            unsigned count = result.face_starts[i + 1] - first;
+            m_poly.Select(face_polys[i]);
+            if (count < 3)
+            {
+                m_poly.Remove();
+                m_written.deleted ++;
+            }
+            else
+            {
+                m_poly.SetMarks(m_mark_done);
+                m_poly.SetVertexList(&face_points[first], count, rev);
+                m_written.polygons ++;
+            }
+        }
+
+        LXtPolygonID new_pol;
+        for (auto i = 0u; i < new_tris.size(); i += 3)
+        {
+            if (i / 3 < new_tri_polys.size())
+                m_poly.Select(new_tri_polys[i / 3]);
+            m_poly.NewProto(LXiPTYP_FACE, &new_tris[i], 3, rev, &new_pol);
+        }
+        for (auto pol : removed_polys)
+        {
+            m_poly.Select(pol);
+            m_poly.Remove();
+        }
+        m_written.polygons += static_cast<unsigned>(new_tris.size() / 3);
+        m_written.deleted  += static_cast<unsigned>(removed_polys.size());
+
+        PROFILE_COUNT(PC_WrittenElements, m_written.Total());
+        return LXe_OK;
+    }
+
 
     bool FaceIsUpdated(CFace& face)
     {
@@ -752,62 +1362,145 @@ struct CMesh
     }
 
     //
-    // Get vertex list for the given face.
+    // Get vertex list for the given face. The list is the boundary loop of the surviving
+    // triangles, which consists of the directed edges without their reverse in the face. When
+    // the triangles make more than one loop, the loop of the largest area on the face plane is
+    // the outer loop and the loops winding the other way are its holes, which are bridged into
+    // a keyhole polygon. This fails when the triangles make more than one outer loop, and the
+    // face is written as its triangles instead.
     //
     LxResult GetPointsFromFace(CFace& face, std::vector<LXtPointID>& points)
     {
+        typedef std::pair<LXtPointID,LXtPointID> DirectedEdge;
+
         points.clear();
+
+        std::vector<DirectedEdge> edges;
+        edges.reserve(face.tris.size() * 3);
         for (auto& tri : face.tris)
         {
             if (tri->deleted)
                 continue;
-            if (points.empty())
+            edges.push_back(std::make_pair(tri->v0->vrt, tri->v1->vrt));
+            edges.push_back(std::make_pair(tri->v1->vrt, tri->v2->vrt));
+            edges.push_back(std::make_pair(tri->v2->vrt, tri->v0->vrt));
+        }
+        auto less = [](const DirectedEdge& a, const DirectedEdge& b) {
+            if (a.first != b.first)
+                return std::less<LXtPointID>()(a.first, b.first);
+            return std::less<LXtPointID>()(a.second, b.second);
+        };
+        std::sort(edges.begin(), edges.end(), less);
+
+        // Boundary edges sorted by their start vertex.
+        std::vector<DirectedEdge> border;
+        for (auto i = 0u; i < edges.size(); i++)
+        {
+            if (i > 0 && edges[i] == edges[i - 1])
+                continue;
+            DirectedEdge rev = std::make_pair(edges[i].second, edges[i].first);
+            if (!std::binary_search(edges.begin(), edges.end(), rev, less))
+                border.push_back(edges[i]);
+        }
+
+        std::vector<char>                    used(border.size(), 0);
+        std::vector<std::vector<LXtPointID>> loops;
+        for (auto i = 0u; i < border.size(); i++)
+        {
+            if (used[i])
+                continue;
+            loops.emplace_back();
+            auto& loop = loops.back();
+            auto  e    = i;
+            while (!used[e])
             {
-                points.push_back(tri->v0->vrt);
-                points.push_back(tri->v1->vrt);
-                points.push_back(tri->v2->vrt);
+                used[e] = 1;
+                loop.push_back(border[e].first);
+                auto it = std::lower_bound(border.begin(), border.end(), std::make_pair(border[e].second, LXtPointID(nullptr)), less);
+                while (it != border.end() && it->first == border[e].second && used[it - border.begin()])
+                    it ++;
+                if (it == border.end() || it->first != border[e].second)
+                    break;
+                e = static_cast<unsigned>(it - border.begin());
             }
-            else
+        }
+        if (loops.size() < 2)
+        {
+            if (!loops.empty())
+                points.swap(loops.front());
+            return LXe_OK;
+        }
+
+        // Project the loops on the plane of the face normal by the current positions.
+        std::unordered_map<LXtPointID,const double*> positions;
+        LXtVector norm = { 0.0, 0.0, 0.0 };
+        for (auto& tri : face.tris)
+        {
+            if (tri->deleted)
+                continue;
+            const double* pos[3];
+            CVerxID       v[3] = { tri->v0, tri->v1, tri->v2 };
+            for (auto i = 0u; i < 3; i++)
             {
-                for (auto i = 0u; i < points.size(); i++)
-                {
-                    LXtPointID vrt = nullptr;
-                    auto j = (i + 1) % points.size();
-                    if (points[i] == tri->v1->vrt && points[j] == tri->v0->vrt)
-                    {
-                        vrt = tri->v2->vrt;
-                    }
-                    else if (points[i] == tri->v2->vrt && points[j] == tri->v1->vrt)
-                    {
-                        vrt = tri->v0->vrt;
-                    }
-                    else if (points[i] == tri->v0->vrt && points[j] == tri->v2->vrt)
-                    {
-                        vrt = tri->v1->vrt;
-                    }
-                    if (vrt != nullptr)
-                    {
-                        points.insert(points.begin() + j, vrt);
-                        break;
-                    }
-                }
+                pos[i] = v[i]->moved ? v[i]->new_pos : v[i]->pos;
+                positions[v[i]->vrt] = pos[i];
             }
+            // Area weighted normal of the triangle.
+            LXtVector a, b, cross;
+            LXx_VSUB3(a, pos[1], pos[0]);
+            LXx_VSUB3(b, pos[2], pos[0]);
+            LXx_VCROSS(cross, a, b);
+            LXx_VADD(norm, cross);
         }
-        if (points.size() > 2)
+        if (LXx_VDOT(norm, norm) <= 0.0)
+            return LXe_FAILED;
+        AxisPlane axisPlane(norm);
+
+        std::vector<std::vector<CLxVector>> vectors(loops.size());
+        std::vector<double>                 areas(loops.size(), 0.0);
+        unsigned                            outer = 0;
+        for (auto i = 0u; i < loops.size(); i++)
         {
-            if (points.front() == points.back())
-                points.pop_back();
+            for (auto vrt : loops[i])
+            {
+                double x, y, z;
+                axisPlane.ToPlane(positions[vrt], x, y, z);
+                vectors[i].push_back(CLxVector(x, y, z));
+            }
+            auto n = vectors[i].size();
+            for (auto j = 0u; j < n; j++)
+                areas[i] += vectors[i][j][0] * vectors[i][(j + 1) % n][1] - vectors[i][(j + 1) % n][0] * vectors[i][j][1];
+            if (std::abs(areas[i]) > std::abs(areas[outer]))
+                outer = i;
         }
+
+        std::vector<std::vector<LXtPointID>> holes;
+        std::vector<std::vector<CLxVector>>  hole_vectors;
+        for (auto i = 0u; i < loops.size(); i++)
+        {
+            if (i == outer)
+                continue;
+            if ((areas[i] > 0.0) == (areas[outer] > 0.0))
+                return LXe_FAILED;
+            holes.push_back(std::move(loops[i]));
+            hole_vectors.push_back(std::move(vectors[i]));
+        }
+        MeshUtil::MakeKeyhole(loops[outer], vectors[outer], holes, hole_vectors, points);
         return LXe_OK;
     }
 
     void Clear()
     {
         m_vertices.clear();
-        m_edges.clear();
         m_triangles.clear();
         m_faces.clear();
         m_parts.clear();
+        m_merge.clear();
+        m_survivor.clear();
+        m_times.Clear();
+        m_triStats.Clear();
+        m_written.Clear();
+        m_result.Clear();
     }
 
     LxResult Remove(CLxUser_Mesh& edit_mesh)
@@ -856,12 +1549,26 @@ struct CMesh
     }
 
 
-    std::vector<CEdgeID>     m_edges;
-    std::vector<CVerxID>     m_vertices;
-    std::vector<CTriangleID> m_triangles;
-    std::vector<CPartID>     m_parts;
+    CMeshVector<CVerxID>     m_vertices;
+    CMeshVector<CTriangleID> m_triangles;
+    CMeshVector<CPartID>     m_parts;
+
+    std::unordered_map<LXtPolygonID, CFace, std::hash<LXtPolygonID>, std::equal_to<LXtPolygonID>,
+                       CMeshAllocator<std::pair<const LXtPolygonID, CFace>>> m_faces;
+
+    CMeshVector<unsigned>    m_merge;   // merged vertex index of each vertex for ResolveMerges
+    CMeshVector<unsigned>    m_survivor;    // surviving vertex index of each vertex by the last ResolveMerges
 
-    std::unordered_map<LXtPolygonID, CFace> m_faces;
+    bool        m_spatialOrder = false;     // sort the vertices and triangles by Morton order in BuildMesh
+    int         m_threads = 0;  // worker threads, 0 uses the hardware concurrency
+    std::function<bool(const char* phase, double fraction)> m_progress;    // polled by BuildMesh, false stops it, may be empty
+    unsigned    m_npolygons = 0;    // polygons of the base mesh of BuildMesh
+    unsigned    m_visited = 0;      // polygons visited by the phase of BuildMesh
+    bool        m_stopped = false;  // BuildMesh was stopped by m_progress
+    CPhaseTimes m_times;    // phase timing of the last evaluation
+    CTriangulateStats m_triStats;   // polygons by triangulation method of the last evaluation
+    CWriteStats m_written;  // elements written by the last ApplyMesh
+    CDecimateResult m_result;   // changes applied by the last ApplyMesh
 
     CLxUser_Mesh        m_mesh;
     CLxUser_Edge        m_edge;
@@ -7,7 +7,9 @@
 #include "decimate.hpp"
 #include "util.hpp"
 
+#include <lxsdk/lx_io.hpp>
 #include <lxsdk/lx_layer.hpp>
+#include <lxsdk/lx_stddialog.hpp>
 #include <lxsdk/lxu_math.hpp>
 #include <lxsdk/lxu_vector.hpp>
 #include <lxsdk/lxu_command.hpp>
@@ -18,6 +20,11 @@
 #define ATTRs_COST   "costStrategy"
 #define ATTRs_PREBND "preserveBoundary"
 #define ATTRs_PREMAT "preserveMaterial"
+#define ATTRs_CACHE  "cacheDir"
+#define ATTRs_TIME   "timeBudget"
+#define ATTRs_CLUS   "cluster"
+#define ATTRs_TILE   "tiles"
+#define ATTRs_ORDER  "reorder"
 
 #define ATTRa_MODE     0
 #define ATTRa_RATIO    1
@@ -25,6 +32,11 @@
 #define ATTRa_COST     3
 #define ATTRa_PREBND   4
 #define ATTRa_PREMAT   5
+#define ATTRa_CACHE    6
+#define ATTRa_TIME     7
+#define ATTRa_CLUS     8
+#define ATTRa_TILE     9
+#define ATTRa_ORDER    10
 
 class CCommand : public CLxBasicCommand
 {
@@ -61,6 +73,21 @@ public:
 
         dyna_Add(ATTRs_PREMAT, LXsTYPE_BOOLEAN);
 
+        dyna_Add(ATTRs_CACHE, LXsTYPE_STRING);
+        basic_SetFlags(ATTRa_CACHE, LXfCMDARG_OPTIONAL);
+
+        dyna_Add(ATTRs_TIME, LXsTYPE_TIME);
+        basic_SetFlags(ATTRa_TIME, LXfCMDARG_OPTIONAL);
+
+        dyna_Add(ATTRs_CLUS, LXsTYPE_BOOLEAN);
+        basic_SetFlags(ATTRa_CLUS, LXfCMDARG_OPTIONAL);
+
+        dyna_Add(ATTRs_TILE, LXsTYPE_INTEGER);
+        basic_SetFlags(ATTRa_TILE, LXfCMDARG_OPTIONAL);
+
+        dyna_Add(ATTRs_ORDER, LXsTYPE_BOOLEAN);
+        basic_SetFlags(ATTRa_ORDER, LXfCMDARG_OPTIONAL);
+
         select_mode = msh_S.SetMode(LXsMARK_SELECT);
     }
 
@@ -100,17 +127,53 @@ public:
         dyna_Value(ATTRa_COST).GetInt(&dec.m_cost);
         dyna_Value(ATTRa_PREBND).GetInt(&dec.m_preserveBoundary);
         dyna_Value(ATTRa_PREMAT).GetInt(&dec.m_preserveMaterial);
+        dec.m_collectStats = 1;
+        if (dyna_IsSet(ATTRa_CACHE))
+            dyna_String(ATTRa_CACHE, dec.m_cacheDir);
+        if (dyna_IsSet(ATTRa_TIME))
+            dyna_Value(ATTRa_TIME).GetFlt(&dec.m_timeBudget);
+        if (dyna_IsSet(ATTRa_CLUS))
+            dyna_Value(ATTRa_CLUS).GetInt(&dec.m_cluster);
+        if (dyna_IsSet(ATTRa_TILE))
+            dyna_Value(ATTRa_TILE).GetInt(&dec.m_tiles);
+        if (dyna_IsSet(ATTRa_ORDER))
+            dyna_Value(ATTRa_ORDER).GetInt(&dec.m_reorder);
     
 		sel_scene.Get(scene);
     
         lyr_S.BeginScan(LXf_LAYERSCAN_ACTIVE, scan);
         scan.Count(&n);
 
+        // The collapse runs on a worker thread and the monitor steps with its progress.
+        // Aborting the monitor cancels the collapse and leaves the layer unexported.
+        CLxUser_StdDialogService dlg_S;
+        CLxUser_Monitor          monitor;
+        unsigned                 stepped = 0;
+        if (dlg_S.MonitorAllocate("Decimate", monitor))
+        {
+            monitor.Init(100 * n);
+            dec.m_background = 1;
+            dec.m_progress   = [&](const char* phase, double fraction) {
+                unsigned step  = static_cast<unsigned>(PhaseProgress(phase, fraction) * 100.0);
+                unsigned delta = (step > stepped) ? step - stepped : 0;
+                stepped += delta;
+                return monitor.Step(delta);    // a zero step still checks the abort
+            };
+        }
+
         for (auto i = 0u; i < n; i++)
         {
             scan.BaseMeshByIndex(i, base_mesh);
 
-            dec.DecimateMesh(base_mesh);
+            stepped = 0;
+            if (dec.DecimateMesh(base_mesh) != LXe_OK)
+            {
+                if (dec.m_cancel && dec.m_cancel->IsCancelled())
+                    break;
+                continue;
+            }
+            if (monitor.test() && stepped < 100)
+                monitor.Step(100 - stepped);
 
             scene.NewItem(LXsTYPE_MESH, meshItem);
 
@@ -119,9 +182,18 @@ public:
                 scene.SetChannels (chanWrite, LXs_ACTIONLAYER_EDIT, 0.0);
                 if (chanWrite.Object (meshItem, index, new_mesh)) {
                     dec.m_cmesh.WriteMesh(new_mesh);
+                    PROFILE_REPORT(dec.m_cmesh.m_times);
+                    dec.m_stats.Report();
                 }
             }
         }
+
+        if (monitor.test())
+        {
+            dec.m_progress = nullptr;
+            monitor.clear();
+            dlg_S.MonitorRelease();
+        }
     }
 
     LxResult cmd_DialogInit(void)
@@ -12,7 +12,8 @@
 #include <map>
 #include <unordered_map>
 #include <unordered_set>
-#include <iostream>
+#include <chrono>
+#include <future>
 
 #include <CGAL/Simple_cartesian.h>
 #include <CGAL/Surface_mesh.h>
@@ -24,10 +25,18 @@
 #include <CGAL/Surface_mesh_simplification/Policies/Edge_collapse/GarlandHeckbert_policies.h>
 #include <CGAL/Surface_mesh_simplification/Policies/Edge_collapse/LindstromTurk_cost.h>
 #include <CGAL/Surface_mesh_simplification/Policies/Edge_collapse/LindstromTurk_placement.h>
+#include <CGAL/Surface_mesh_simplification/Policies/Edge_collapse/Constrained_placement.h>
 #include <CGAL/Surface_mesh_simplification/Edge_collapse_visitor_base.h>
+#include <CGAL/AABB_tree.h>
+#include <CGAL/AABB_traits_3.h>
+#include <CGAL/AABB_triangle_primitive_3.h>
 
 #include "decimate.hpp"
 #include "triangulate.hpp"
+#include "cache.hpp"
+#include "logcache.hpp"
+#include "incremental.hpp"
+#include "cluster.hpp"
 
 //
 // Edge Collapse class.
@@ -44,30 +53,128 @@ typedef SMS::GarlandHeckbert_probabilistic_plane_policies<Surface_mesh, Kernel>
 typedef SMS::GarlandHeckbert_triangle_policies<Surface_mesh, Kernel>               Classic_tri;
 typedef SMS::GarlandHeckbert_probabilistic_triangle_policies<Surface_mesh, Kernel> Prob_tri;
 
+typedef std::map<Surface_mesh::Edge_index, bool, std::less<Surface_mesh::Edge_index>,
+                 CountingAllocator<std::pair<const Surface_mesh::Edge_index, bool>, MP_Constraints>> ConstraintMap;
+
+typedef std::tuple<Surface_mesh::Vertex_index, Surface_mesh::Vertex_index, bool>    CollapseRecord;
+typedef std::vector<CollapseRecord, CountingAllocator<CollapseRecord, MP_CollapseLog>> CollapseLog;
+
+//
+// Estimate the bytes of the Surface_mesh from the element counts since its property arrays
+// use the default allocator. Garland-Heckbert policies add a quadric matrix per vertex.
+//
+static size_t SurfaceMeshBytes(const Surface_mesh& mesh, int cost)
+{
+    size_t nv = mesh.number_of_vertices() + mesh.number_of_removed_vertices();
+    size_t nh = mesh.number_of_halfedges() + mesh.number_of_removed_halfedges();
+    size_t nf = mesh.number_of_faces() + mesh.number_of_removed_faces();
+    size_t ne = nh / 2;
+
+    size_t bytes = nv * (sizeof(Surface_mesh::Halfedge_index) + sizeof(Point_3))
+                 + nh * (3 * sizeof(Surface_mesh::Halfedge_index) + sizeof(Surface_mesh::Face_index))
+                 + nf * sizeof(Surface_mesh::Halfedge_index)
+                 + (nv + ne + nf) / 8;
+    if (cost == CDecimate::Garland_Heckbert)
+        bytes += nv * 16 * sizeof(double);
+    return bytes;
+}
+
+//
+// Test if the edge between the points is constrained: a locked edge, an open boundary with
+// Preserve Boundary, or a border of materials with Preserve Material. The diagonals made by
+// the triangulation are not edges of the mesh and never constrained.
+//
+static bool IsConstrainedEdge(CDecimate* context, CLxUser_Edge& uedge, CLxUser_Polygon& upoly0, CLxUser_Polygon& upoly1,
+                              LXtPointID v0, LXtPointID v1)
+{
+    if (uedge.SelectEndpoints(v0, v1) != LXe_OK)
+        return false;
+    if (uedge.TestMarks(context->m_cmesh.m_mark_lock) == LXe_TRUE)
+        return true;
+    if (context->m_preserveBoundary)
+    {
+        if (uedge.IsBorder() == LXe_TRUE)
+            return true;
+    }
+    if (context->m_preserveMaterial)
+    {
+        unsigned int count;
+        uedge.PolygonCount(&count);
+        if (count != 2)
+            return false;
+        LXtPolygonID pol;
+        uedge.PolygonByIndex(0, &pol);
+        upoly0.Select(pol);
+        uedge.PolygonByIndex(1, &pol);
+        upoly1.Select(pol);
+        CLxUser_StringTag tag0, tag1;
+        tag0.set(upoly0);
+        tag1.set(upoly1);
+        const char *mat0 = tag0.Value(LXi_PTAG_MATR);
+        const char *mat1 = tag1.Value(LXi_PTAG_MATR);
+        if (std::string(mat0) != std::string(mat1))
+            return true;
+    }
+    return false;
+}
+
+//
+// Test if the edge touches the ring of the cell in the incremental mode. All edges around the
+// ring points are constrained, so the ring points are neither merged nor moved.
+//
+static bool IsRingEdge(CDecimate* context, const CVerxID& v0, const CVerxID& v1)
+{
+    const std::vector<char>& ring = context->m_ring;
+    return !ring.empty() && (ring[v0->vrt_index] || ring[v1->vrt_index]);
+}
+
 //
 // Convert the internal CDecimate mesh representation to a CGAL Surface_mesh.
 //
-static void ConvertToCGALMesh(Surface_mesh& out_mesh, std::map<Surface_mesh::Edge_index, bool>& constrained_edges, CDecimate* context)
+static void ConvertToCGALMesh(Surface_mesh& out_mesh, ConstraintMap& constrained_edges, CDecimate* context)
 {
     CMesh& cmesh = context->m_cmesh;
 
-    std::unordered_map<CVerxID, Surface_mesh::Vertex_index> vertex_map;
+    CStopwatch watch;
+
+    // CMesh vertex index is identical to the Surface_mesh vertex index since the vertices are
+    // added in the same order into the reserved mesh.
+    out_mesh.reserve(static_cast<Surface_mesh::size_type>(cmesh.m_vertices.size()),
+                     static_cast<Surface_mesh::size_type>(cmesh.m_triangles.size() * 3 / 2 + cmesh.m_vertices.size()),
+                     static_cast<Surface_mesh::size_type>(cmesh.m_triangles.size()));
 
+    // The vertices merged by the clustering stay as isolated vertices to keep the indices.
     for (auto& v : cmesh.m_vertices)
     {
-        Point_3 p(v->pos[0], v->pos[1], v->pos[2]);
-        Surface_mesh::Vertex_index vi = out_mesh.add_vertex(p);
-        vertex_map[v] = vi;
+        out_mesh.add_vertex(Point_3(v->new_pos[0], v->new_pos[1], v->new_pos[2]));
     }
 
+    // The caller checks the cancellation after the conversion, which stops at the next batch.
+    // A triangle rejected as non-manifold, as by the clustering of two close sheets, stays in
+    // the internal mesh, so the edges around its vertices are constrained to keep them.
+    static const size_t Batch = 65536;
+    size_t ntris = cmesh.m_triangles.size(), count = 0;
+    std::vector<char> keep;
     for (auto& tri : cmesh.m_triangles)
     {
-        Surface_mesh::Vertex_index v0 = vertex_map[tri->v0];
-        Surface_mesh::Vertex_index v1 = vertex_map[tri->v1];
-        Surface_mesh::Vertex_index v2 = vertex_map[tri->v2];
-        out_mesh.add_face(v0, v1, v2);
+        if ((count++ % Batch) == 0 && context->Cancelled("convert", static_cast<double>(count - 1) / ntris))
+            return;
+        if (tri->deleted)
+            continue;
+        Surface_mesh::Vertex_index v0(tri->v0->index);
+        Surface_mesh::Vertex_index v1(tri->v1->index);
+        Surface_mesh::Vertex_index v2(tri->v2->index);
+        if (out_mesh.add_face(v0, v1, v2) != Surface_mesh::null_face())
+            continue;
+        if (keep.empty())
+            keep.assign(cmesh.m_vertices.size(), 0);
+        keep[tri->v0->index] = keep[tri->v1->index] = keep[tri->v2->index] = 1;
+        PROFILE_COUNT(PC_RejectedFaces, 1);
     }
+    cmesh.m_times.convert = watch.Elapsed();
+    PROFILE_PHASE("convert", watch);
 
+    watch.Reset();
     CLxUser_Edge    uedge;
     uedge.fromMesh(cmesh.m_mesh);
 
@@ -75,202 +182,1397 @@ static void ConvertToCGALMesh(Surface_mesh& out_mesh, std::map<Surface_mesh::Edg
     upoly0.fromMesh(cmesh.m_mesh);
     upoly1.fromMesh(cmesh.m_mesh);
 
-    printf("Total edges in CGAL mesh: %lu material (%d)\n", static_cast<unsigned long>(out_mesh.number_of_edges()), context->m_preserveMaterial);
+    PROFILE_COUNT(PC_Edges, out_mesh.number_of_edges());
+    size_t nedges = out_mesh.number_of_edges();
+    count = 0;
     for (auto e : out_mesh.edges())
     {
-        // ここでは全てのエッジを非制約エッジとする例
-        constrained_edges[e] = false;
+        if ((count++ % Batch) == 0 && context->Cancelled("constrain", static_cast<double>(count - 1) / nedges))
+            return;
         auto he = out_mesh.halfedge(e);
         auto i0 = out_mesh.source(he);
         auto i1 = out_mesh.target(he);
         auto v0 = cmesh.m_vertices[i0]->vrt;
         auto v1 = cmesh.m_vertices[i1]->vrt;
-        uedge.SelectEndpoints(v0, v1);
-        if (uedge.TestMarks(cmesh.m_mark_lock) == LXe_TRUE)
+        constrained_edges[e] = IsConstrainedEdge(context, uedge, upoly0, upoly1, v0, v1) ||
+                               IsRingEdge(context, cmesh.m_vertices[i0], cmesh.m_vertices[i1]) ||
+                               (!keep.empty() && (keep[i0] || keep[i1]));
+    }
+    cmesh.m_times.constrain = watch.Elapsed();
+    PROFILE_PHASE("constrain", watch);
+#ifdef DECIMATE_PROFILE
+    for (auto& [e, locked] : constrained_edges)
+    {
+        if (locked)
+            PROFILE_COUNT(PC_ConstrainedEdges, 1);
+    }
+#endif
+}
+
+//
+// Build the internal mesh of the base mesh. The build polls the progress and stops at the
+// cancellation, which the caller checks after it.
+//
+static void BuildMesh(CLxUser_Mesh& base_mesh, CDecimate* context)
+{
+    CMesh& cmesh = context->m_cmesh;
+    cmesh.m_spatialOrder = context->m_reorder != 0;
+    if (context->m_progress || context->m_cancel)
+        cmesh.m_progress = [context](const char* phase, double fraction) { return !context->Cancelled(phase, fraction); };
+    cmesh.BuildMesh(base_mesh, context->m_polys);
+    cmesh.m_progress = nullptr;
+}
+
+struct VertexMapVisitor : public SMS::Edge_collapse_visitor_base<Surface_mesh>
+{
+    // マップ：元の頂点 → 残った／統合された頂点
+    CollapseLog& vmap;
+
+    // 統計（オプション）：nullptr の場合は集計しない
+    CCollapseStats*          stats  = nullptr;
+    const std::vector<char>* locked = nullptr;    // 制約エッジに接する頂点
+    FT                       cost   = 0;          // 選択中のエッジのコスト
+
+    // 折りたたみ列（オプション）：nullptr の場合は記録しない
+    std::vector<CCollapseStep>* steps = nullptr;
+    std::size_t                 edges = 0;        // 選択時のエッジ数
+    std::optional<Point_3>      placement;        // 折りたたみ後の頂点位置
+
+    VertexMapVisitor(CollapseLog& _vmap)
+      : vmap(_vmap) {}
+
+    // 停止条件に到達
+    void OnStopConditionReached(const Profile& profile)
+    {
+        if (stats)
+            stats->stop_reached = true;
+    }
+
+    // 優先度キューから取り出された候補
+    void OnSelected(const Profile& profile, const std::optional<FT>& _cost, std::size_t initial, std::size_t current)
+    {
+        edges = current;
+        if (!stats)
+            return;
+        stats->selected ++;
+        if (!_cost)
         {
-            constrained_edges[e] = true;
-            continue;
+            stats->no_cost ++;
+            return;
+        }
+        cost = *_cost;
+        stats->histogram[CCollapseStats::Bin(cost)] ++;
+    }
+
+    // 折りたたまれる直前
+    void OnCollapsing(const Profile& profile, const std::optional<Point_3>& _placement)
+    {
+        placement = _placement;
+        if (stats && !_placement)
+            stats->placement_fallback ++;
+    }
+
+    // 折りたたみ完了時
+    void OnCollapsed(const Profile& profile, Surface_mesh::Vertex_index new_v)
+    {
+        auto v0 = profile.v0();
+        auto v1 = profile.v1();
+        bool forward = (new_v == v0);
+        vmap.emplace_back(v0, v1, forward);
+        if (steps)
+        {
+            Point_3 p = placement ? *placement : profile.surface_mesh().point(new_v);
+            steps->push_back({ static_cast<uint32_t>(v0), static_cast<uint32_t>(v1), forward ? 1u : 0u,
+                               static_cast<uint32_t>(edges), { p.x(), p.y(), p.z() } });
         }
-        if (context->m_preserveBoundary)
+        if (stats)
         {
-            if (uedge.IsBorder() == LXe_TRUE)
-            {
-                constrained_edges[e] = true;
-                continue;
-            }
+            stats->collapsed ++;
+            if (cost > stats->max_cost)
+                stats->max_cost = cost;
         }
-        if (context->m_preserveMaterial)
+    }
+
+    // 位相条件により折りたたみ不可
+    void OnNonCollapsable(const Profile& profile)
+    {
+        PROFILE_COUNT(PC_RejectedCollapses, 1);
+        if (!stats)
+            return;
+        auto v0 = static_cast<size_t>(profile.v0());
+        auto v1 = static_cast<size_t>(profile.v1());
+        if (locked && ((*locked)[v0] || (*locked)[v1]))
+            stats->constraint ++;
+        else
+            stats->topology ++;
+    }
+};
+
+//
+// Collapse edges of the surface mesh by the cost strategy until the stop predicate is reached.
+// The vertices on the edges set in pinned, if given, also keep their positions.
+//
+template <typename StopPredicate>
+static int CollapseEdges(Surface_mesh& surface_mesh, const StopPredicate& stop, VertexMapVisitor& visitor,
+                         ConstraintMap& constrained_edges, int cost, ConstraintMap* pinned = nullptr)
+{
+    auto constraints = boost::make_assoc_property_map(constrained_edges);
+    auto collapse = [&](const auto& get_cost, const auto& get_placement) -> int {
+        auto params = CGAL::parameters::visitor(visitor).get_cost(get_cost).edge_is_constrained_map(constraints);
+        if (pinned)
         {
-            unsigned int count;
-            uedge.PolygonCount(&count);
-            if (count != 2)
-                continue;
-            LXtPolygonID pol;
-            uedge.PolygonByIndex(0, &pol);
-            upoly0.Select(pol);
-            uedge.PolygonByIndex(1, &pol);
-            upoly1.Select(pol);
-            CLxUser_StringTag tag0, tag1;
-            tag0.set(upoly0);
-            tag1.set(upoly1);
-            const char *mat0 = tag0.Value(LXi_PTAG_MATR);
-            const char *mat1 = tag1.Value(LXi_PTAG_MATR);
-            if (std::string(mat0) != std::string(mat1))
+            auto pins = boost::make_assoc_property_map(*pinned);
+            typedef SMS::Constrained_placement<std::decay_t<decltype(get_placement)>, decltype(pins)> Pinned;
+            return SMS::edge_collapse(surface_mesh, stop, params.get_placement(Pinned(pins, get_placement)));
+        }
+        return SMS::edge_collapse(surface_mesh, stop, params.get_placement(get_placement));
+    };
+
+    if (cost == CDecimate::Lindstrom_Turk)
+        return collapse(SMS::LindstromTurk_cost<Surface_mesh>(), SMS::LindstromTurk_placement<Surface_mesh>());
+    if (cost == CDecimate::Garland_Heckbert)
+    {
+        GHPolicies policies(surface_mesh);
+        return collapse(policies.get_cost(), policies.get_placement());
+    }
+    return collapse(SMS::Edge_length_cost<Surface_mesh>(), SMS::Midpoint_placement<Surface_mesh>());
+}
+
+//
+// Stop predicate which ends the collapse when the decimation is cancelled or the deadline has
+// passed. The cancellation, the deadline and the progress are checked once per batch of
+// candidates, and the collapse stopped by them leaves a valid mesh with fewer collapses.
+//
+struct CancellableStopPredicate
+{
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t Batch = 1024;
+
+    SMS::Edge_count_stop_predicate<Surface_mesh> stop;
+    const CCancelToken*                          cancel;
+    std::atomic<double>&                         fraction;
+    std::function<bool(double)>                  report;     // called on the collapse thread, may be empty
+    size_t                                       target;
+    Clock::time_point                            deadline = Clock::time_point::max();
+    std::atomic<bool>*                           expired  = nullptr;    // set when the deadline stopped it
+    mutable size_t                               calls = 0;
+
+    CancellableStopPredicate(size_t _target, const CCancelToken* _cancel, std::atomic<double>& _fraction)
+        : stop(_target), cancel(_cancel), fraction(_fraction), target(_target) {}
+
+    template <typename F, typename Profile>
+    bool operator()(const F& cost, const Profile& profile, std::size_t initial, std::size_t current) const
+    {
+        if ((++calls % Batch) == 0)
+        {
+            if (initial > target)
+                fraction.store(static_cast<double>(initial - std::min(current, initial)) / (initial - target));
+            if (report && !report(fraction.load()))
+                return true;
+            if (cancel && cancel->IsCancelled())
+                return true;
+            if (Clock::now() >= deadline)
             {
-                constrained_edges[e] = true;
-                continue;
+                if (expired)
+                    expired->store(true);
+                return true;
             }
         }
+        return stop(cost, profile, initial, current);
     }
+};
+
+//
+// Collapse edges until the target edge count, the cancellation or the deadline. With m_background, the
+// collapse runs on a worker thread and the progress is reported from the calling thread.
+//
+static int RunCollapse(Surface_mesh& surface_mesh, int target_count, VertexMapVisitor& visitor,
+                       ConstraintMap& constrained_edges, CDecimate* context,
+                       CancellableStopPredicate::Clock::time_point deadline = CancellableStopPredicate::Clock::time_point::max(),
+                       std::atomic<bool>* expired = nullptr)
+{
+    std::atomic<double> fraction{0.0};
+    size_t target = static_cast<size_t>(std::max(target_count, 0));
+    CancellableStopPredicate stop(target, context->m_cancel.get(), fraction);
+    stop.deadline = deadline;
+    stop.expired  = expired;
+
+    if (!context->m_background)
+    {
+        if (context->m_progress)
+            stop.report = [context](double f) { return !context->Cancelled("collapse", f); };
+        return CollapseEdges(surface_mesh, stop, visitor, constrained_edges, context->m_cost);
+    }
+
+    // The worker checks the token, which is created here so the caller can cancel it.
+    if (!context->m_cancel)
+        context->m_cancel = std::make_shared<CCancelToken>();
+    stop.cancel = context->m_cancel.get();
+    auto job = std::async(std::launch::async, [&]() {
+        return CollapseEdges(surface_mesh, stop, visitor, constrained_edges, context->m_cost);
+    });
+    while (job.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready)
+        context->Cancelled("collapse", fraction.load());
+    return job.get();
 }
 
-static void PrintCGALMesh(Surface_mesh& mesh)
+//
+// Replay the collapse steps which the edge count stop predicate with the target count lets
+// through. The steps are selected with decreasing edge counts, so they are a prefix of the log.
+//
+static unsigned ReplaySteps(CMesh& cmesh, const CCollapseStep* steps, unsigned nsteps, int target_count)
 {
-    std::cout << "Vertices:" << std::endl;
-    for (auto v : mesh.vertices())
+    unsigned count = 0;
+    while (count < nsteps && static_cast<int>(steps[count].edges) >= target_count)
+        count ++;
+
+    for (auto i = 0u; i < count; i++)
     {
-        Point_3 p = mesh.point(v);
-        std::cout << "  Vertex " << v << ": (" << p.x() << ", " << p.y() << ", " << p.z() << ")" << std::endl;
+        const CCollapseStep& step = steps[i];
+        if (step.forward)
+            cmesh.MergeVertex(step.v1, step.v0);
+        else
+            cmesh.MergeVertex(step.v0, step.v1);
     }
+    cmesh.ResolveMerges();
 
-    std::cout << "Faces:" << std::endl;
-    for (auto f : mesh.faces())
+    // The surviving vertex of each collapse is placed by the last collapse into it.
+    for (auto i = 0u; i < count; i++)
+    {
+        const CCollapseStep& step = steps[i];
+        auto& cv = cmesh.m_vertices[step.forward ? step.v0 : step.v1];
+        LXx_VCPY(cv->new_pos, step.pos);
+    }
+    for (auto& cv : cmesh.m_vertices)
     {
-        std::cout << "  Face " << f << ":";
-        for (auto v : CGAL::vertices_around_face(mesh.halfedge(f), mesh))
+        if (!cv->collapsed && (cv->new_pos[0] != cv->pos[0] || cv->new_pos[1] != cv->pos[1] || cv->new_pos[2] != cv->pos[2]))
+            cv->moved = true;
+    }
+    return count;
+}
+
+//
+// Cluster the vertices of the built mesh into a few times the target vertex count. The
+// vertices on the constrained edges are kept as they are. The edge count of the mesh before
+// the clustering is returned for the target of the collapse.
+//
+static size_t ClusterVertices(CDecimate* context)
+{
+    CMesh& cmesh = context->m_cmesh;
+
+    CStopwatch watch;
+    CLxUser_Edge    uedge;
+    CLxUser_Polygon upoly0, upoly1;
+    uedge.fromMesh(cmesh.m_mesh);
+    upoly0.fromMesh(cmesh.m_mesh);
+    upoly1.fromMesh(cmesh.m_mesh);
+
+    // Each edge is visited from its lower vertex.
+    size_t nedges = 0;
+    std::vector<char>     locked(cmesh.m_vertices.size(), 0);
+    std::vector<unsigned> ring;
+    for (auto& v : cmesh.m_vertices)
+    {
+        ring.clear();
+        for (auto& tri : v->tris)
         {
-            std::cout << " " << v;
+            for (auto* w : { &tri->v0, &tri->v1, &tri->v2 })
+            {
+                if ((*w)->index > v->index)
+                    ring.push_back((*w)->index);
+            }
+        }
+        std::sort(ring.begin(), ring.end());
+        ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+        nedges += ring.size();
+        for (auto w : ring)
+        {
+            if (IsConstrainedEdge(context, uedge, upoly0, upoly1, v->vrt, cmesh.m_vertices[w]->vrt) ||
+                IsRingEdge(context, v, cmesh.m_vertices[w]))
+                locked[v->index] = locked[w] = 1;
         }
-        std::cout << std::endl;
     }
-    for (auto e : mesh.edges())
+
+    int target = context->TargetCount(static_cast<unsigned>(nedges));
+    if (target > 0)
     {
-        auto he = mesh.halfedge(e);
-        auto v0 = mesh.source(he);
-        auto v1 = mesh.target(he);
-        std::cout << "  Edge " << e << ": (" << v0 << " - " << v1 << ")" << std::endl;
+        // A closed triangle mesh has about three edges per vertex.
+        size_t nclusters = static_cast<size_t>(CVertexCluster::Factor * target / 3.0);
+        unsigned merged = CVertexCluster::Cluster(cmesh, nclusters, locked, context->m_threads);
+        PROFILE_COUNT(PC_ClusteredVertices, merged);
     }
+    cmesh.m_times.cluster = watch.Elapsed();
+    PROFILE_PHASE("cluster", watch);
+    return nedges;
 }
 
-struct VertexMapVisitor : public SMS::Edge_collapse_visitor_base<Surface_mesh>
+//
+// Result of the collapse of one tile in the vertex indices of the whole surface mesh.
+//
+struct CTileCollapse
 {
-    // マップ：元の頂点 → 残った／統合された頂点
-    std::vector<std::tuple<Surface_mesh::Vertex_index, Surface_mesh::Vertex_index, bool>>& vmap;
+    CollapseLog           log;          // collapses of the tile
+    std::vector<uint32_t> survivors;    // vertices left in the tile
+    std::vector<Point_3>  points;       // positions of the survivors
+    std::vector<uint32_t> faces;        // vertex triples of the faces left in the tile
+    CCollapseStats        stats;
+};
 
-    VertexMapVisitor(std::vector<std::tuple<Surface_mesh::Vertex_index, Surface_mesh::Vertex_index, bool>>& _vmap)
-      : vmap(_vmap) {}
+//
+// Collapse the spatial tiles of the surface mesh in parallel before the seam pass. The faces
+// are ordered by the Morton codes of their centroids and cut into tiles of equal face counts.
+// Each tile is collapsed by the ratio of the target on its own thread with the edges between
+// the tiles constrained and their vertices pinned, so the tiles still meet exactly. The tiles
+// are stitched into a new surface mesh of the same vertex indices, which replaces the surface
+// mesh, and the constraints are replaced to free only the edges around the seams. The merges of
+// the tiles are added to vertex_map. Return false when the mesh is too small to tile.
+//
+static bool CollapseTiles(Surface_mesh& surface_mesh, ConstraintMap& constrained_edges, int target_count,
+                          CollapseLog& vertex_map, CDecimate* context,
+                          CancellableStopPredicate::Clock::time_point deadline, std::atomic<bool>* expired)
+{
+    // A tile smaller than this costs more to build than its collapse saves.
+    static const size_t MinTileFaces = 4096;
+    static const uint32_t none = ~0u;
 
-    // 折りたたまれる直前
-#if 0
-    void OnCollapsing(const Profile& profile,
-                    std::optional<Point> placement)
+    size_t nverts = surface_mesh.number_of_vertices();
+    size_t nfaces = surface_mesh.number_of_faces();
+    size_t ntiles = std::min<size_t>(static_cast<size_t>(std::max(context->m_tiles, 0)), nfaces / MinTileFaces);
+    if (ntiles < 2)
+        return false;
+    double rate = static_cast<double>(std::max(target_count, 0)) / std::max<size_t>(surface_mesh.number_of_edges(), 1);
+
+    // Morton order of the face centroids.
+    double lo[3], hi[3];
+    for (auto k = 0; k < 3; k++)
     {
-        auto v0 = profile.v0();
-        auto v1 = profile.v1();
-        printf("Collapsing edge (%lu) - (%lu)\n", static_cast<unsigned long>(v0), static_cast<unsigned long>(v1));
-        // v1 を v0 に統合する（例示：実際にどちらに残るかは policy による）
-        //vmap[v1] = v0;
+        lo[k] = std::numeric_limits<double>::max();
+        hi[k] = -std::numeric_limits<double>::max();
     }
-#endif
-    // 折りたたみ完了時
-    void OnCollapsed(const Profile& profile, Surface_mesh::Vertex_index new_v)
+    for (auto v : surface_mesh.vertices())
     {
-        auto v0 = profile.v0();
-        auto v1 = profile.v1();
-        bool forward = (new_v == v0);
-        vmap.emplace_back(v0, v1, forward);
+        const Point_3& p = surface_mesh.point(v);
+        for (auto k = 0; k < 3; k++)
+        {
+            lo[k] = std::min(lo[k], p[k]);
+            hi[k] = std::max(hi[k], p[k]);
+        }
     }
-};
+    std::vector<std::pair<uint64_t, uint32_t>> order(nfaces);
+    ThreadUtil::ParallelFor(nfaces, context->m_threads, [&](size_t begin, size_t end) {
+        for (auto i = begin; i < end; i++)
+        {
+            double c[3] = { 0.0, 0.0, 0.0 };
+            Surface_mesh::Face_index f(static_cast<Surface_mesh::size_type>(i));
+            for (auto v : CGAL::vertices_around_face(surface_mesh.halfedge(f), surface_mesh))
+            {
+                const Point_3& p = surface_mesh.point(v);
+                for (auto k = 0; k < 3; k++)
+                    c[k] += p[k] / 3.0;
+            }
+            order[i] = { MathUtil::MortonCode(c, lo, hi), static_cast<uint32_t>(i) };
+        }
+    });
+    std::sort(order.begin(), order.end());
+
+    // The vertices shared by the faces of different tiles are on the seams.
+    std::vector<uint32_t> vtile(nverts, none);
+    std::vector<char>     seam(nverts, 0);
+    for (auto i = 0u; i < nfaces; i++)
+    {
+        uint32_t t = static_cast<uint32_t>(i * ntiles / nfaces);
+        Surface_mesh::Face_index f(order[i].second);
+        for (auto v : CGAL::vertices_around_face(surface_mesh.halfedge(f), surface_mesh))
+        {
+            auto& owner = vtile[static_cast<size_t>(v)];
+            if (owner == none)
+                owner = t;
+            else if (owner != t)
+                seam[static_cast<size_t>(v)] = 1;
+        }
+    }
+
+    auto is_constrained = [&](uint32_t a, uint32_t b) {
+        auto h = surface_mesh.halfedge(Surface_mesh::Vertex_index(a), Surface_mesh::Vertex_index(b));
+        if (h == Surface_mesh::null_halfedge())
+            return false;
+        auto it = constrained_edges.find(surface_mesh.edge(h));
+        return it != constrained_edges.end() && it->second;
+    };
+
+    // Collapse each tile on its own mesh. The faces which do not fit into the tile mesh at a
+    // non-manifold vertex are left with their vertices pinned.
+    std::vector<CTileCollapse> tiles(ntiles);
+    std::atomic<size_t> finished{0};
+    auto collapse_tiles = [&](size_t begin, size_t end) {
+        for (auto t = begin; t < end; t++)
+        {
+            CTileCollapse&        result = tiles[t];
+            Surface_mesh          mesh;
+            std::vector<uint32_t> global;
+            std::unordered_map<uint32_t, uint32_t> local;
+            std::vector<uint32_t> kept;
+            auto local_vertex = [&](Surface_mesh::Vertex_index v) {
+                auto it = local.emplace(static_cast<uint32_t>(v), static_cast<uint32_t>(global.size()));
+                if (it.second)
+                {
+                    global.push_back(static_cast<uint32_t>(v));
+                    mesh.add_vertex(surface_mesh.point(v));
+                }
+                return Surface_mesh::Vertex_index(it.first->second);
+            };
+
+            size_t first = t * nfaces / ntiles, last = (t + 1) * nfaces / ntiles;
+            for (auto i = first; i < last; i++)
+            {
+                Surface_mesh::Face_index f(order[i].second);
+                auto h = surface_mesh.halfedge(f);
+                Surface_mesh::Vertex_index v0 = local_vertex(surface_mesh.source(h));
+                Surface_mesh::Vertex_index v1 = local_vertex(surface_mesh.target(h));
+                Surface_mesh::Vertex_index v2 = local_vertex(surface_mesh.target(surface_mesh.next(h)));
+                if (mesh.add_face(v0, v1, v2) == Surface_mesh::null_face())
+                    kept.insert(kept.end(), { global[v0], global[v1], global[v2] });
+            }
+
+            std::vector<char> pin(global.size(), 0);
+            for (auto g : kept)
+                pin[local[g]] = 1;
+
+            // The borders of the tile which are not borders of the mesh face the other tiles.
+            ConstraintMap constraints, pins;
+            size_t nconstrained = 0;
+            for (auto e : mesh.edges())
+            {
+                auto he = mesh.halfedge(e);
+                auto a  = static_cast<size_t>(mesh.source(he));
+                auto b  = static_cast<size_t>(mesh.target(he));
+                bool inner = mesh.is_border(e) && !surface_mesh.is_border(surface_mesh.edge(
+                                 surface_mesh.halfedge(Surface_mesh::Vertex_index(global[a]), Surface_mesh::Vertex_index(global[b]))));
+                pins[e] = inner || pin[a] || pin[b];
+                constraints[e] = pins[e] || is_constrained(global[a], global[b]);
+                if (constraints[e])
+                    nconstrained ++;
+            }
+
+            size_t free   = mesh.number_of_edges() - nconstrained;
+            size_t target = nconstrained + static_cast<size_t>(std::llround(rate * free));
+
+            std::vector<char> locked;
+            VertexMapVisitor  visitor(result.log);
+            if (context->m_collectStats)
+            {
+                locked.resize(global.size(), 0);
+                for (auto& [e, constrained] : constraints)
+                {
+                    if (!constrained)
+                        continue;
+                    auto he = mesh.halfedge(e);
+                    locked[static_cast<size_t>(mesh.source(he))] = 1;
+                    locked[static_cast<size_t>(mesh.target(he))] = 1;
+                }
+                visitor.stats  = &result.stats;
+                visitor.locked = &locked;
+            }
+            std::atomic<double> fraction{0.0};
+            CancellableStopPredicate stop(target, context->m_cancel.get(), fraction);
+            stop.deadline = deadline;
+            stop.expired  = expired;
+            CollapseEdges(mesh, stop, visitor, constraints, context->m_cost, &pins);
+
+            // Back to the indices of the whole mesh.
+            for (auto& [v0, v1, forward] : result.log)
+            {
+                v0 = Surface_mesh::Vertex_index(global[static_cast<size_t>(v0)]);
+                v1 = Surface_mesh::Vertex_index(global[static_cast<size_t>(v1)]);
+            }
+            for (auto v : mesh.vertices())
+            {
+                result.survivors.push_back(global[static_cast<size_t>(v)]);
+                result.points.push_back(mesh.point(v));
+            }
+            for (auto f : mesh.faces())
+            {
+                for (auto v : CGAL::vertices_around_face(mesh.halfedge(f), mesh))
+                    result.faces.push_back(global[static_cast<size_t>(v)]);
+            }
+            result.faces.insert(result.faces.end(), kept.begin(), kept.end());
+            finished ++;
+        }
+    };
+
+    // With m_background, the tiles run on worker threads and the progress is reported from the
+    // calling thread as in RunCollapse.
+    if (context->m_background)
+    {
+        if (!context->m_cancel)
+            context->m_cancel = std::make_shared<CCancelToken>();
+        auto job = std::async(std::launch::async, [&]() { ThreadUtil::ParallelFor(ntiles, context->m_threads, collapse_tiles, 1); });
+        while (job.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready)
+            context->Cancelled("tiles", static_cast<double>(finished.load()) / ntiles);
+        job.get();
+    }
+    else
+        ThreadUtil::ParallelFor(ntiles, context->m_threads, collapse_tiles, 1);
+
+    // A seam vertex can be merged in more than one tile, so the merges are joined and added as
+    // merges of each vertex into the root of its group.
+    std::vector<uint32_t> parent(nverts);
+    for (auto i = 0u; i < nverts; i++)
+        parent[i] = i;
+    auto find = [&](uint32_t v) {
+        while (parent[v] != v)
+            v = parent[v] = parent[parent[v]];
+        return v;
+    };
+    for (auto& result : tiles)
+    {
+        for (auto& [v0, v1, forward] : result.log)
+        {
+            uint32_t keep = find(static_cast<uint32_t>(forward ? v0 : v1));
+            uint32_t gone = find(static_cast<uint32_t>(forward ? v1 : v0));
+            if (keep != gone)
+                parent[gone] = keep;
+        }
+        if (context->m_collectStats)
+            context->m_stats.Add(result.stats);
+    }
+    for (auto i = 0u; i < nverts; i++)
+    {
+        uint32_t root = find(i);
+        if (root != i)
+        {
+            vertex_map.emplace_back(Surface_mesh::Vertex_index(root), Surface_mesh::Vertex_index(i), true);
+            seam[root] |= seam[i];
+        }
+    }
+
+    // Stitch the tiles. The vertices keep their indices and the merged ones stay isolated.
+    Surface_mesh stitched;
+    stitched.reserve(static_cast<Surface_mesh::size_type>(nverts), static_cast<Surface_mesh::size_type>(nverts * 3),
+                     static_cast<Surface_mesh::size_type>(nfaces));
+    for (auto v : surface_mesh.vertices())
+        stitched.add_vertex(surface_mesh.point(v));
+    std::vector<char> locked(nverts, 0);
+    for (auto& result : tiles)
+    {
+        for (auto i = 0u; i < result.survivors.size(); i++)
+        {
+            if (find(result.survivors[i]) == result.survivors[i])
+                stitched.point(Surface_mesh::Vertex_index(result.survivors[i])) = result.points[i];
+        }
+        for (auto i = 0u; i + 2 < result.faces.size(); i += 3)
+        {
+            uint32_t a = find(result.faces[i]), b = find(result.faces[i + 1]), c = find(result.faces[i + 2]);
+            if (a == b || b == c || c == a)
+                continue;
+            if (stitched.add_face(Surface_mesh::Vertex_index(a), Surface_mesh::Vertex_index(b),
+                                  Surface_mesh::Vertex_index(c)) == Surface_mesh::null_face())
+                locked[a] = locked[b] = locked[c] = 1;
+        }
+        result = CTileCollapse();
+    }
+
+    // The seam pass collapses only the edges around the seams.
+    ConstraintMap seam_edges;
+    for (auto e : stitched.edges())
+    {
+        auto he = stitched.halfedge(e);
+        auto a  = static_cast<uint32_t>(stitched.source(he));
+        auto b  = static_cast<uint32_t>(stitched.target(he));
+        seam_edges[e] = locked[a] || locked[b] || !(seam[a] || seam[b]) || is_constrained(a, b);
+    }
+    surface_mesh = std::move(stitched);
+    constrained_edges.swap(seam_edges);
+    return true;
+}
 
 //
 // Decimmate the mesh by the given ratio.
 //
 LxResult CDecimate::DecimateMesh(CLxUser_Mesh& base_mesh)
 {
-    m_cmesh.BuildMesh(base_mesh);
+    if (!m_cacheDir.empty())
+        return DecimateByLog(base_mesh);
+
+    PROFILE_BEGIN();
+    CMemoryTracker& tracker = CMemoryTracker::Get();
+    m_cmesh.Clear();
+    tracker.ResetPeak();
+
+    // The time budget counts from here, so the collapse gets what the building leaves.
+    auto deadline = CancellableStopPredicate::Clock::time_point::max();
+    if (m_timeBudget > 0.0)
+        deadline = CancellableStopPredicate::Clock::now() +
+                   std::chrono::duration_cast<CancellableStopPredicate::Clock::duration>(std::chrono::duration<double>(m_timeBudget));
+    m_expired = 0;
+    m_reached = 1.0;
+
+    m_cmesh.m_threads = m_threads;
+    BuildMesh(base_mesh, this);
+    m_memory.build = tracker.Snapshot();
+    if (Cancelled("triangulate", 1.0))
+        return Abort();
+
+    // The clustering and the collapse redirect the triangles in place.
+    m_sourceVerts.clear();
+    m_sourceTris.clear();
+    if (m_sequence)
+        m_cmesh.ExportTopology(m_sourceVerts, m_sourceTris);
+
+    // The clustering reduces the mesh before the conversion, and the target of the collapse is
+    // taken from the edge count before it.
+    size_t nedges = 0;
+    if (m_cluster)
+        nedges = ClusterVertices(this);
 
     Surface_mesh surface_mesh;
-    std::map<Surface_mesh::Edge_index, bool> constrained_edges;
+    ConstraintMap constrained_edges;
     ConvertToCGALMesh(surface_mesh, constrained_edges, this);
-    //PrintCGALMesh(surface_mesh);
+    if (Cancelled("convert", 1.0))
+        return Abort();
 
-    std::vector<std::tuple<Surface_mesh::Vertex_index, Surface_mesh::Vertex_index, bool>> vertex_map;
+    size_t surface_bytes = SurfaceMeshBytes(surface_mesh, m_cost);
+    tracker.Allocate(MP_SurfaceMesh, surface_bytes);
+    m_memory.convert = tracker.Snapshot();
 
-    int target_count = static_cast<int>(surface_mesh.number_of_edges());
+    CollapseLog vertex_map;
 
-    if (m_mode == CDecimate::Ratio)
-        target_count *= m_ratio;
-    else if (m_mode == CDecimate::Count)
-        target_count -= m_count;
-
-    //SMS::Edge_count_ratio_stop_predicate<Surface_mesh> stop(m_ratio);
-    SMS::Edge_count_stop_predicate<Surface_mesh> stop(target_count);
+    if (!m_cluster)
+        nedges = surface_mesh.number_of_edges();
+    int target_count = TargetCount(static_cast<unsigned>(nedges));
 
     // Visitor 登録
     VertexMapVisitor visitor(vertex_map);
 
-    int r = 0;
+    std::vector<char> locked;
+    if (m_collectStats)
+    {
+        m_stats.Clear();
+        locked.resize(surface_mesh.number_of_vertices(), 0);
+        for (auto& [e, constrained] : constrained_edges)
+        {
+            if (!constrained)
+                continue;
+            auto he = surface_mesh.halfedge(e);
+            locked[static_cast<size_t>(surface_mesh.source(he))] = 1;
+            locked[static_cast<size_t>(surface_mesh.target(he))] = 1;
+            m_stats.constrained_edges ++;
+        }
+        visitor.stats  = &m_stats;
+        visitor.locked = &locked;
+    }
 
-    if (m_cost == CDecimate::Lindstrom_Turk)
+    size_t initial_edges = surface_mesh.number_of_edges();
+
+    CStopwatch watch;
+    std::atomic<bool> expired{false};
+    int r = 0;
+    if (m_tiles > 1 && CollapseTiles(surface_mesh, constrained_edges, target_count, vertex_map, this, deadline, &expired))
+        r = static_cast<int>(vertex_map.size());
+    if (!expired.load() && !(m_cancel && m_cancel->IsCancelled()))
+        r += RunCollapse(surface_mesh, target_count, visitor, constrained_edges, this, deadline, &expired);
+    m_cmesh.m_times.collapse = watch.Elapsed();
+    PROFILE_PHASE("collapse", watch);
+    PROFILE_COUNT(PC_CollapsedEdges, r);
+    if (Cancelled("collapse", 1.0))
     {
-        std::cout << "Using Lindstrom-Turk cost and placement.\n";
-        r = SMS::edge_collapse(
-            surface_mesh,
-            stop,
-            CGAL::parameters::visitor(visitor)
-                            .get_cost(SMS::LindstromTurk_cost<Surface_mesh>())
-                            .get_placement(SMS::LindstromTurk_placement<Surface_mesh>())
-                            .edge_is_constrained_map(boost::make_assoc_property_map(constrained_edges))
-            );
+        tracker.Deallocate(MP_SurfaceMesh, surface_bytes);
+        return Abort();
     }
-    else if (m_cost == CDecimate::Garland_Heckbert)
+    if (expired.load())
     {
-        std::cout << "Using Garland-Heckbert cost and placement.\n";
-        GHPolicies policies(surface_mesh);
-        r = SMS::edge_collapse(
-            surface_mesh,
-            stop,
-            CGAL::parameters::visitor(visitor)
-                            .get_cost(policies.get_cost())
-                            .get_placement(policies.get_placement())
-                            .edge_is_constrained_map(boost::make_assoc_property_map(constrained_edges))
-            );
+        size_t target = static_cast<size_t>(std::max(target_count, 0));
+        size_t edges  = surface_mesh.number_of_edges();
+        m_expired = 1;
+        if (initial_edges > target)
+            m_reached = static_cast<double>(initial_edges - std::min(edges, initial_edges)) / (initial_edges - target);
+        ReportBudget(initial_edges, edges, target);
     }
-    else
+
+    watch.Reset();
+    for (const auto& [v0, v1, forward] : vertex_map)
     {
-        std::cout << "Using Edge Length cost and Midpoint placement.\n";
-        r = SMS::edge_collapse(
-            surface_mesh,
-            stop,
-            CGAL::parameters::visitor(visitor)
-                            .get_cost(SMS::Edge_length_cost<Surface_mesh>())
-                            .get_placement(SMS::Midpoint_placement<Surface_mesh>())
-                            .edge_is_constrained_map(boost::make_assoc_property_map(constrained_edges))
-            );
-    }
-    std::cout << "\nFinished!\n" << r << " edges removed.\n" << surface_mesh.number_of_edges() << " final edges.\n";
-    //PrintCGALMesh(surface_mesh);
-    for (const auto& [v0, v1, forward] : vertex_map) {
-        m_cmesh.CollapseEdge(static_cast<int>(v0), static_cast<int>(v1), forward);
+        if (forward)
+            m_cmesh.MergeVertex(static_cast<unsigned>(v1), static_cast<unsigned>(v0));
+        else
+            m_cmesh.MergeVertex(static_cast<unsigned>(v0), static_cast<unsigned>(v1));
     }
+    m_cmesh.ResolveMerges();
     for (auto v : surface_mesh.vertices())
     {
         Point_3 p = surface_mesh.point(v);
         auto cv = m_cmesh.m_vertices[static_cast<size_t>(v)];
         if (cv->collapsed)
             continue;
-        cv->new_pos[0] = p.x();
-        cv->new_pos[1] = p.y();
-        cv->new_pos[2] = p.z();
+        if (cv->new_pos[0] != p.x() || cv->new_pos[1] != p.y() || cv->new_pos[2] != p.z())
+        {
+            cv->new_pos[0] = p.x();
+            cv->new_pos[1] = p.y();
+            cv->new_pos[2] = p.z();
+            cv->moved = true;
+        }
+    }
+    m_cmesh.m_times.replay = watch.Elapsed();
+    PROFILE_PHASE("replay", watch);
+
+    // The surface mesh, the constraint map and the collapse log are released at return.
+    m_memory.decimate = tracker.Snapshot();
+    tracker.Deallocate(MP_SurfaceMesh, surface_bytes);
+    return LXe_OK;
+}
+
+//
+// Decimate the indexed mesh for the streaming mode. The open border edges are constrained and
+// their vertices pinned, so the chunks still meet exactly at their borders. The triangles
+// which do not fit into the surface mesh are kept as they are with their vertices.
+//
+LxResult CDecimate::DecimateIndexed(std::vector<double>& points, std::vector<uint32_t>& tris, std::vector<char>& border,
+                                    const std::vector<char>* raw)
+{
+    size_t npoints = points.size() / 3;
+    size_t ntris   = tris.size() / 3;
+
+    Surface_mesh surface_mesh;
+    surface_mesh.reserve(static_cast<Surface_mesh::size_type>(npoints),
+                         static_cast<Surface_mesh::size_type>(ntris * 3 / 2 + npoints),
+                         static_cast<Surface_mesh::size_type>(ntris));
+    for (auto i = 0u; i < npoints; i++)
+        surface_mesh.add_vertex(Point_3(points[i * 3], points[i * 3 + 1], points[i * 3 + 2]));
+
+    std::vector<uint32_t> rejected;
+    for (auto i = 0u; i < ntris; i++)
+    {
+        Surface_mesh::Vertex_index v0(tris[i * 3]), v1(tris[i * 3 + 1]), v2(tris[i * 3 + 2]);
+        if (surface_mesh.add_face(v0, v1, v2) == Surface_mesh::null_face())
+            rejected.insert(rejected.end(), &tris[i * 3], &tris[i * 3 + 3]);
     }
+
+    // The edges around the vertices of the rejected triangles are constrained to keep them.
+    ConstraintMap constrained_edges;
+    std::vector<char> keep(npoints, 0);
+    for (auto index : rejected)
+        keep[index] = 1;
+    unsigned nconstrained = 0, nraw = 0;
+    for (auto e : surface_mesh.edges())
+    {
+        auto he = surface_mesh.halfedge(e);
+        auto i0 = static_cast<size_t>(surface_mesh.source(he));
+        auto i1 = static_cast<size_t>(surface_mesh.target(he));
+        bool constrained = surface_mesh.is_border(e) || keep[i0] || keep[i1];
+        constrained_edges[e] = constrained;
+        if (constrained)
+            nconstrained ++;
+        else if (raw && (*raw)[i0] && (*raw)[i1])
+            nraw ++;
+    }
+
+    // The ratio applies to the free edges, or only to the free edges between the raw points
+    // when they are given, since the others are reduced already.
+    size_t nfree  = surface_mesh.number_of_edges() - nconstrained;
+    if (!raw)
+        nraw = static_cast<unsigned>(nfree);
+    int    target = TargetCount(nraw) + static_cast<int>(nfree - nraw) + static_cast<int>(nconstrained);
+
+    CollapseLog      vertex_map;
+    VertexMapVisitor visitor(vertex_map);
+    std::atomic<double> fraction{0.0};
+    CancellableStopPredicate stop(static_cast<size_t>(std::max(target, 0)), m_cancel.get(), fraction);
+    CollapseEdges(surface_mesh, stop, visitor, constrained_edges, m_cost, &constrained_edges);
+    if (m_cancel && m_cancel->IsCancelled())
+        return LXe_ABORT;
+
+    // Compact the surviving vertices and mark the ones on the constrained edges.
+    static const uint32_t none = ~0u;
+    std::vector<uint32_t> remap(npoints, none);
+    std::vector<double>   out_points;
+    out_points.reserve(surface_mesh.number_of_vertices() * 3);
+    border.clear();
+    for (auto v : surface_mesh.vertices())
+    {
+        if (surface_mesh.is_isolated(v) && !keep[static_cast<size_t>(v)])
+            continue;
+        Point_3 p = surface_mesh.point(v);
+        remap[static_cast<size_t>(v)] = static_cast<uint32_t>(out_points.size() / 3);
+        out_points.insert(out_points.end(), { p.x(), p.y(), p.z() });
+        border.push_back(keep[static_cast<size_t>(v)]);
+    }
+    for (auto e : surface_mesh.edges())
+    {
+        if (!constrained_edges[e])
+            continue;
+        auto he = surface_mesh.halfedge(e);
+        border[remap[static_cast<size_t>(surface_mesh.source(he))]] = 1;
+        border[remap[static_cast<size_t>(surface_mesh.target(he))]] = 1;
+    }
+
+    std::vector<uint32_t> out_tris;
+    out_tris.reserve(surface_mesh.number_of_faces() * 3 + rejected.size());
+    for (auto f : surface_mesh.faces())
+    {
+        for (auto v : CGAL::vertices_around_face(surface_mesh.halfedge(f), surface_mesh))
+            out_tris.push_back(remap[static_cast<size_t>(v)]);
+    }
+    for (auto index : rejected)
+        out_tris.push_back(remap[index]);
+
+    points.swap(out_points);
+    tris.swap(out_tris);
+    return LXe_OK;
+}
+
+//
+// Measure the distances from the source vertices to the decimated triangles relative to the
+// diagonal of the bounding box.
+//
+void CDecimate::MeasureError(double& max_error, double& rms_error)
+{
+    typedef std::vector<Kernel::Triangle_3>::const_iterator           Iterator;
+    typedef CGAL::AABB_triangle_primitive_3<Kernel, Iterator>         Primitive;
+    typedef CGAL::AABB_tree<CGAL::AABB_traits_3<Kernel, Primitive>>   Tree;
+
+    max_error = rms_error = 0.0;
+    auto point = [](const LXtVector p) { return Point_3(p[0], p[1], p[2]); };
+
+    std::vector<Kernel::Triangle_3> triangles;
+    triangles.reserve(m_cmesh.m_triangles.size());
     for (auto& tri : m_cmesh.m_triangles)
     {
-        if (tri->deleted)
+        if (!tri->deleted)
+            triangles.emplace_back(point(tri->v0->new_pos), point(tri->v1->new_pos), point(tri->v2->new_pos));
+    }
+    if (triangles.empty() || m_cmesh.m_vertices.empty())
+        return;
+
+    Tree tree(triangles.cbegin(), triangles.cend());
+    tree.accelerate_distance_queries();
+
+    CGAL::Bbox_3 box;
+    double sum = 0.0;
+    for (auto& v : m_cmesh.m_vertices)
+    {
+        Point_3 p = point(v->pos);
+        double  d = std::sqrt(tree.squared_distance(p));
+        box += p.bbox();
+        max_error = std::max(max_error, d);
+        sum += d * d;
+    }
+    rms_error = std::sqrt(sum / m_cmesh.m_vertices.size());
+
+    double diagonal = std::sqrt(CGAL::square(box.xmax() - box.xmin()) + CGAL::square(box.ymax() - box.ymin()) +
+                                CGAL::square(box.zmax() - box.zmin()));
+    if (diagonal > 0.0)
+    {
+        max_error /= diagonal;
+        rms_error /= diagonal;
+    }
+}
+
+//
+// Build the mesh and collapse it as far as possible to record the whole collapse sequence,
+// which is replayed for any ratio or count.
+//
+LxResult CDecimate::RecordLog(CLxUser_Mesh& base_mesh, CCollapseLogData& log)
+{
+    CMemoryTracker& tracker = CMemoryTracker::Get();
+    BuildMesh(base_mesh, this);
+    m_memory.build = tracker.Snapshot();
+    if (Cancelled("triangulate", 1.0))
+        return Abort();
+
+    Surface_mesh surface_mesh;
+    ConstraintMap constrained_edges;
+    ConvertToCGALMesh(surface_mesh, constrained_edges, this);
+    if (Cancelled("convert", 1.0))
+        return Abort();
+
+    size_t surface_bytes = SurfaceMeshBytes(surface_mesh, m_cost);
+    tracker.Allocate(MP_SurfaceMesh, surface_bytes);
+    m_memory.convert = tracker.Snapshot();
+
+    log.header.nedges = static_cast<uint32_t>(surface_mesh.number_of_edges());
+
+    CollapseLog vertex_map;
+    VertexMapVisitor visitor(vertex_map);
+    visitor.steps = &log.steps;
+
+    CStopwatch watch;
+    RunCollapse(surface_mesh, 0, visitor, constrained_edges, this);
+    m_cmesh.m_times.collapse = watch.Elapsed();
+    PROFILE_PHASE("collapse", watch);
+    tracker.Deallocate(MP_SurfaceMesh, surface_bytes);
+    if (Cancelled("collapse", 1.0))
+        return Abort();
+
+    m_cmesh.ExportTopology(log.verts, log.tris);
+    log.header.nverts = static_cast<uint32_t>(log.verts.size());
+    log.header.ntris  = static_cast<uint32_t>(log.tris.size() / 4);
+    log.header.nsteps = static_cast<uint32_t>(log.steps.size());
+    return LXe_OK;
+}
+
+//
+// Target edge count of the stop predicate for the given edge count.
+//
+int CDecimate::TargetCount(unsigned nedges) const
+{
+    int target_count = static_cast<int>(nedges);
+    if (m_mode == CDecimate::Ratio)
+        target_count *= m_ratio;
+    else if (m_mode == CDecimate::Count)
+        target_count -= m_count;
+    return target_count;
+}
+
+//
+// Replay the prefix of the collapse steps for the current mode into the built mesh.
+//
+void CDecimate::ReplayLog(const CCollapseLogHeader& header, const CCollapseStep* steps)
+{
+    CStopwatch watch;
+    unsigned r = ReplaySteps(m_cmesh, steps, header.nsteps, TargetCount(header.nedges));
+    m_cmesh.m_times.replay = watch.Elapsed();
+    PROFILE_PHASE("replay", watch);
+    PROFILE_COUNT(PC_CollapsedEdges, r);
+}
+
+//
+// Decimate the mesh by replaying the collapse log file, which is recorded when it is missing.
+//
+LxResult CDecimate::DecimateByLog(CLxUser_Mesh& base_mesh)
+{
+    PROFILE_BEGIN();
+    CMemoryTracker& tracker = CMemoryTracker::Get();
+    m_cmesh.Clear();
+    tracker.ResetPeak();
+    m_cmesh.m_threads = m_threads;
+    m_stats.Clear();
+    m_sourceVerts.clear();
+    m_sourceTris.clear();
+
+    // The log does not depend on the reduction mode and the ratio or count.
+    CContentHash key;
+    key.Add(MeshContentHash(base_mesh));
+    key.Add(m_cost);
+    key.Add(m_preserveBoundary);
+    key.Add(m_preserveMaterial);
+
+    unsigned npnt = 0, npol = 0;
+    base_mesh.PointCount(&npnt);
+    base_mesh.PolygonCount(&npol);
+
+    std::string      path = CCollapseLogFile::Path(m_cacheDir, key.value);
+    CCollapseLogFile file;
+    if (file.Open(path, key.value, npnt, npol) &&
+        m_cmesh.BuildFromTopology(base_mesh, file.Vertices(), file.Header().nverts, file.Triangles(), file.Header().ntris) == LXe_OK)
+    {
+        m_memory.build = tracker.Snapshot();
+        m_memory.convert = m_memory.build;
+        if (m_sequence)
+        {
+            m_sourceVerts.assign(file.Vertices(), file.Vertices() + file.Header().nverts);
+            m_sourceTris.assign(file.Triangles(), file.Triangles() + file.Header().ntris * 4);
+        }
+        ReplayLog(file.Header(), file.Steps());
+        m_memory.decimate = tracker.Snapshot();
+        return LXe_OK;
+    }
+
+    CCollapseLogData log;
+    log.header.key       = key.value;
+    log.header.npoints   = npnt;
+    log.header.npolygons = npol;
+    if (RecordLog(base_mesh, log) != LXe_OK)
+        return LXe_ABORT;
+    CCollapseLogFile::Write(path, log.header, log.verts, log.tris, log.steps);
+    if (m_sequence)
+    {
+        m_sourceVerts = log.verts;
+        m_sourceTris  = log.tris;
+    }
+
+    ReplayLog(log.header, log.steps.data());
+    m_memory.decimate = tracker.Snapshot();
+    return LXe_OK;
+}
+
+//
+// Collapse log of the preview recorded on a worker thread. The mesh is built and converted on
+// the evaluation thread, which owns the mesh access, and only the collapse of the whole
+// sequence runs on the worker. Starting another recording cancels the running one.
+//
+class CPreviewRecorder
+{
+public:
+    static CPreviewRecorder& Instance()
+    {
+        static CPreviewRecorder recorder;
+        return recorder;
+    }
+
+    ~CPreviewRecorder()
+    {
+        if (m_cancel)
+            m_cancel->Cancel();
+    }
+
+    //
+    // Take the finished log of the key. Return null with running set while it is recorded.
+    //
+    std::shared_ptr<CCollapseLogData> Take(uint64_t key, bool& running)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        running = false;
+        if (!m_job.valid() || m_key != key)
+            return nullptr;
+        if (m_job.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            running = true;
+            return nullptr;
+        }
+        auto log = m_job.get();
+        m_cancel.reset();
+        return log;
+    }
+
+    //
+    // Collapse the converted mesh to no edges on a worker thread and record the steps into log.
+    //
+    void Start(uint64_t key, std::shared_ptr<Surface_mesh> surface_mesh, std::shared_ptr<ConstraintMap> constrained_edges,
+               std::shared_ptr<CCollapseLogData> log)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_cancel)
+            m_cancel->Cancel();
+        auto cancel = std::make_shared<CCancelToken>();
+        m_key    = key;
+        m_cancel = cancel;
+        m_job    = std::async(std::launch::async, [surface_mesh, constrained_edges, log, cancel]() mutable {
+            CMemoryTracker& tracker = CMemoryTracker::Get();
+            size_t surface_bytes = SurfaceMeshBytes(*surface_mesh, CDecimate::Edge_Length);
+            tracker.Allocate(MP_SurfaceMesh, surface_bytes);
+
+            CollapseLog vertex_map;
+            VertexMapVisitor visitor(vertex_map);
+            visitor.steps = &log->steps;
+            std::atomic<double> fraction{0.0};
+            CancellableStopPredicate stop(0, cancel.get(), fraction);
+            CollapseEdges(*surface_mesh, stop, visitor, *constrained_edges, CDecimate::Edge_Length);
+
+            surface_mesh.reset();
+            constrained_edges.reset();
+            tracker.Deallocate(MP_SurfaceMesh, surface_bytes);
+            if (cancel->IsCancelled())
+                return std::shared_ptr<CCollapseLogData>();
+            log->header.nsteps = static_cast<uint32_t>(log->steps.size());
+            return log;
+        });
+    }
+
+private:
+    std::mutex                                     m_mutex;
+    uint64_t                                       m_key = 0;
+    std::shared_ptr<CCancelToken>                  m_cancel;
+    std::future<std::shared_ptr<CCollapseLogData>> m_job;
+};
+
+//
+// Decimate the mesh for the preview by Edge-Length cost with midpoint placement. The collapse
+// sequence is kept in memory, so the following previews of the same mesh only replay it. The
+// sequence of a new mesh is recorded in the background, and LXe_NOTFOUND is returned until it
+// is ready, so the first preview of a drag does not wait for the whole collapse.
+//
+LxResult CDecimate::DecimatePreview(CLxUser_Mesh& base_mesh)
+{
+    PROFILE_BEGIN();
+    m_cmesh.Clear();
+    m_cmesh.m_threads = m_threads;
+
+    // The sampled hash keeps the mouse-down frame cheap on a huge mesh.
+    CContentHash key;
+    key.Add(MeshSampleHash(base_mesh));
+    key.Add(static_cast<int>(CDecimate::Edge_Length));
+    key.Add(m_preserveBoundary);
+    key.Add(m_preserveMaterial);
+
+    unsigned npnt = 0, npol = 0;
+    base_mesh.PointCount(&npnt);
+    base_mesh.PolygonCount(&npol);
+
+    auto& cache    = CLogCache::Instance();
+    auto& recorder = CPreviewRecorder::Instance();
+    auto  log      = cache.Find(key.value);
+    if (!log)
+    {
+        bool running = false;
+        auto record  = recorder.Take(key.value, running);
+        if (running)
+            return LXe_NOTFOUND;
+        if (record)
+        {
+            cache.Insert(key.value, record);
+            log = record;
+        }
+    }
+    if (log && log->header.npoints == npnt && log->header.npolygons == npol &&
+        m_cmesh.BuildFromTopology(base_mesh, log->verts.data(), log->header.nverts, log->tris.data(), log->header.ntris) == LXe_OK)
+    {
+        ReplayLog(log->header, log->steps.data());
+        return LXe_OK;
+    }
+
+    auto record = std::make_shared<CCollapseLogData>();
+    record->header.key       = key.value;
+    record->header.npoints   = npnt;
+    record->header.npolygons = npol;
+
+    BuildMesh(base_mesh, this);
+    if (Cancelled("triangulate", 1.0))
+        return Abort();
+
+    auto surface_mesh      = std::make_shared<Surface_mesh>();
+    auto constrained_edges = std::make_shared<ConstraintMap>();
+    ConvertToCGALMesh(*surface_mesh, *constrained_edges, this);
+    if (Cancelled("convert", 1.0))
+        return Abort();
+
+    record->header.nedges = static_cast<uint32_t>(surface_mesh->number_of_edges());
+    m_cmesh.ExportTopology(record->verts, record->tris);
+    record->header.nverts = static_cast<uint32_t>(record->verts.size());
+    record->header.ntris  = static_cast<uint32_t>(record->tris.size() / 4);
+
+    recorder.Start(key.value, surface_mesh, constrained_edges, record);
+    return LXe_NOTFOUND;
+}
+
+//
+// Frame of each cluster of merged vertices by its surviving vertex on the current positions:
+// the tangent toward the anchor vertex, the bitangent and the normal. The normal is the area
+// weighted normal of the source triangles around the vertices of the cluster, so the frame
+// rotates with a deforming part. Degenerated frames are left zero.
+//
+static void ClusterFrames(const CMesh& cmesh, const std::vector<uint32_t>& tris, const std::vector<uint32_t>& survivor,
+                          const std::vector<uint32_t>& anchors, const std::vector<double>& centroid, std::vector<double>& frames)
+{
+    auto nverts = cmesh.m_vertices.size();
+    frames.assign(nverts * 9, 0.0);
+    for (auto i = 0u; i + 4 <= tris.size(); i += 4)
+    {
+        const double* p0 = cmesh.m_vertices[tris[i + 0]]->pos;
+        const double* p1 = cmesh.m_vertices[tris[i + 1]]->pos;
+        const double* p2 = cmesh.m_vertices[tris[i + 2]]->pos;
+        LXtVector a, b, n;
+        LXx_VSUB3(a, p1, p0);
+        LXx_VSUB3(b, p2, p0);
+        LXx_VCROSS(n, a, b);
+        for (auto j = 0u; j < 3; j++)
+            LXx_VADD(&frames[survivor[tris[i + j]] * 9 + 6], n);
+    }
+    for (auto s = 0u; s < nverts; s++)
+    {
+        double* t = &frames[s * 9 + 0];
+        double* b = &frames[s * 9 + 3];
+        double* n = &frames[s * 9 + 6];
+        LXtVector d, proj;
+        bool valid = anchors[s] < nverts && lx::VectorNormalize(n);
+        if (valid)
+        {
+            LXx_VSUB3(d, cmesh.m_vertices[anchors[s]]->pos, &centroid[s * 3]);
+            LXx_VSCL3(proj, n, LXx_VDOT(d, n));
+            LXx_VSUB3(t, d, proj);
+            valid = lx::VectorNormalize(t);
+        }
+        if (!valid)
+        {
+            std::fill(t, t + 9, 0.0);
             continue;
-        if (tri->v0 == tri->v1 || tri->v1 == tri->v2 || tri->v2 == tri->v0)
+        }
+        LXx_VCROSS(b, n, t);
+    }
+}
+
+//
+// Centroid of each cluster of merged vertices by its surviving vertex and the vertex count.
+//
+static void ClusterCentroids(const CMesh& cmesh, const std::vector<uint32_t>& survivor, std::vector<double>& centroid, std::vector<unsigned>& count)
+{
+    auto nverts = cmesh.m_vertices.size();
+    centroid.assign(nverts * 3, 0.0);
+    count.assign(nverts, 0);
+    for (auto& cv : cmesh.m_vertices)
+    {
+        unsigned s = survivor[cv->index];
+        LXx_VADD(&centroid[s * 3], cv->pos);
+        count[s] ++;
+    }
+    for (auto i = 0u; i < nverts; i++)
+    {
+        if (count[i] > 0)
+            LXx_VSCL(&centroid[i * 3], 1.0 / count[i]);
+    }
+}
+
+LxResult CDecimate::MakeSequence(CAnimationSequence& sequence)
+{
+    // The sequence replays the merges on the topology before them.
+    if (m_sourceTris.empty() || m_sourceVerts.size() != m_cmesh.m_vertices.size())
+        return LXe_FAILED;
+    sequence.verts = m_sourceVerts;
+    sequence.tris  = m_sourceTris;
+
+    auto nverts = m_cmesh.m_vertices.size();
+    sequence.survivor.resize(nverts);
+    for (auto i = 0u; i < nverts; i++)
+        sequence.survivor[i] = m_cmesh.m_survivor.empty() ? i : m_cmesh.m_survivor[i];
+
+    std::vector<double>   centroid;
+    std::vector<unsigned> count;
+    ClusterCentroids(m_cmesh, sequence.survivor, centroid, count);
+
+    // The anchor of a cluster is its vertex farthest from the centroid.
+    sequence.anchors.assign(nverts, ~0u);
+    std::vector<double> dmax(nverts, 0.0);
+    for (auto& cv : m_cmesh.m_vertices)
+    {
+        unsigned  s = sequence.survivor[cv->index];
+        LXtVector d;
+        LXx_VSUB3(d, cv->pos, &centroid[s * 3]);
+        double    len = LXx_VLEN(d);
+        if (count[s] > 1 && len > dmax[s])
+        {
+            dmax[s]             = len;
+            sequence.anchors[s] = cv->index;
+        }
+    }
+
+    std::vector<double> frames;
+    ClusterFrames(m_cmesh, sequence.tris, sequence.survivor, sequence.anchors, centroid, frames);
+
+    sequence.offsets.assign(nverts * 3, 0.0);
+    for (auto& cv : m_cmesh.m_vertices)
+    {
+        unsigned i = cv->index;
+        if (cv->collapsed || count[i] == 0)
+            continue;
+        LXtVector d;
+        LXx_VSUB3(d, cv->new_pos, &centroid[i * 3]);
+        const double* frame = &frames[i * 9];
+        if (LXx_VDOT(&frame[6], &frame[6]) > 0.0)
+        {
+            sequence.offsets[i * 3 + 0] = LXx_VDOT(d, &frame[0]);
+            sequence.offsets[i * 3 + 1] = LXx_VDOT(d, &frame[3]);
+            sequence.offsets[i * 3 + 2] = LXx_VDOT(d, &frame[6]);
+        }
+        else
+        {
+            sequence.anchors[i] = ~0u;
+            LXx_VCPY(&sequence.offsets[i * 3], d);
+        }
+    }
+    return LXe_OK;
+}
+
+LxResult CDecimate::DecimateBySequence(CLxUser_Mesh& base_mesh, const CAnimationSequence& sequence)
+{
+    PROFILE_BEGIN();
+    m_cmesh.m_threads = m_threads;
+    if (m_cmesh.BuildFromTopology(base_mesh, sequence.verts.data(), static_cast<unsigned>(sequence.verts.size()),
+                                  sequence.tris.data(), static_cast<unsigned>(sequence.tris.size() / 4)) != LXe_OK)
+        return LXe_FAILED;
+
+    CStopwatch watch;
+    auto nverts = m_cmesh.m_vertices.size();
+    for (auto i = 0u; i < nverts; i++)
+    {
+        if (sequence.survivor[i] != i)
+            m_cmesh.MergeVertex(i, sequence.survivor[i]);
+    }
+    m_cmesh.ResolveMerges();
+
+    std::vector<double>   centroid, frames;
+    std::vector<unsigned> count;
+    ClusterCentroids(m_cmesh, sequence.survivor, centroid, count);
+    ClusterFrames(m_cmesh, sequence.tris, sequence.survivor, sequence.anchors, centroid, frames);
+    for (auto& cv : m_cmesh.m_vertices)
+    {
+        unsigned i = cv->index;
+        if (cv->collapsed || count[i] < 2)
+            continue;
+        const double* o     = &sequence.offsets[i * 3];
+        const double* frame = &frames[i * 9];
+        LXx_VCPY(cv->new_pos, &centroid[i * 3]);
+        if (sequence.anchors[i] == ~0u)
+            LXx_VADD(cv->new_pos, o);
+        else
         {
-            tri->deleted = true;
+            // A frame degenerated on this frame leaves the vertex at the centroid.
+            for (auto k = 0u; k < 3; k++)
+                cv->new_pos[k] += o[0] * frame[k] + o[1] * frame[3 + k] + o[2] * frame[6 + k];
         }
+        cv->moved = true;
     }
+    m_cmesh.m_times.replay = watch.Elapsed();
+    PROFILE_PHASE("replay", watch);
+    return LXe_OK;
+}
+
+LxResult CDecimate::DecimateIncremental(CLxUser_Mesh& base_mesh, uint64_t params)
+{
+    CMeshCells split;
+    split.Split(base_mesh);
+
+    auto& cache = CResultCache::Instance();
+    auto  ncells = split.cells.size();
+    std::vector<uint64_t> keys(ncells);
+    std::vector<std::shared_ptr<const CDecimateResult>> locals(ncells);
+    std::vector<unsigned> changed;
+    for (auto i = 0u; i < ncells; i++)
+    {
+        const CMeshCell& cell = split.cells[i];
+        CContentHash key;
+        key.Add(cell.hash);
+        key.Add(params);
+        keys[i]   = key.value;
+        locals[i] = cache.Find(key.value);
+        if (!locals[i] || locals[i]->npoints != cell.points.size() || locals[i]->npolygons != cell.polys.size())
+            changed.push_back(i);
+    }
+
+    if (!changed.empty())
+    {
+        // Each changed cell is decimated alone with its ring locked, so the result of a cell
+        // depends only on its content. The internal mesh is built from the polygons of the cell.
+        m_ring.assign(split.npoints, 0);
+        int      expired = 0;
+        LxResult status  = LXe_OK;
+        for (auto i : changed)
+        {
+            const CMeshCell& cell = split.cells[i];
+            split.MarkRing(i, m_ring, 1);
+            m_polys = &cell.polys;
+            status  = DecimateMesh(base_mesh);
+            m_polys = nullptr;
+            split.MarkRing(i, m_ring, 0);
+            if (status != LXe_OK)
+                break;
+            expired |= m_expired;
+
+            CDecimateResult result;
+            m_cmesh.MakeResult(m_triple, result);
+            locals[i] = split.LocalResult(result, i);
+            if (!m_expired)
+                cache.Insert(keys[i], locals[i]);
+        }
+        m_ring.clear();
+        m_expired = expired;
+        if (status != LXe_OK)
+            return status;
+    }
+    else
+    {
+        m_cmesh.Clear();
+    }
+
+    split.MergeResults(locals, m_cmesh.m_result);
     return LXe_OK;
 }
@@ -17,9 +17,219 @@
 
 #include <vector>
 #include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 
 #include "util.hpp"
 #include "cmesh.hpp"
+#include "memory.hpp"
+#include "logcache.hpp"
+
+//
+// Collapse statistics aggregated by the edge collapse visitor.
+//
+struct CCollapseStats
+{
+    // log10 cost histogram. Bin 0 is for zero cost, then 2 bins per decade from 1e-12.
+    static const unsigned Bins = 34;
+
+    uint64_t selected          = 0;     // candidates taken from the priority queue
+    uint64_t collapsed         = 0;     // collapsed edges
+    uint64_t no_cost           = 0;     // candidates without computable cost
+    uint64_t placement_fallback = 0;    // collapses without a placement, which keep the default position
+    uint64_t topology          = 0;     // candidates rejected by topology test
+    uint64_t constraint        = 0;     // rejected candidates touching constrained edges
+    uint64_t constrained_edges = 0;     // edges never collected since they are constrained
+    bool     stop_reached      = false; // stop predicate was reached
+    double   max_cost          = 0.0;   // maximum cost of collapsed edges
+    uint64_t histogram[Bins]   = {};    // cost distribution of the selected candidates
+
+    void Clear()
+    {
+        *this = CCollapseStats();
+    }
+
+    static unsigned Bin(double cost)
+    {
+        if (cost <= 0.0)
+            return 0;
+        int bin = static_cast<int>(std::floor((std::log10(cost) + 12.0) * 2.0)) + 1;
+        if (bin < 1)
+            return 1;
+        if (bin >= static_cast<int>(Bins))
+            return Bins - 1;
+        return static_cast<unsigned>(bin);
+    }
+
+    // Add the statistics of another collapse such as a tile.
+    void Add(const CCollapseStats& s)
+    {
+        selected     += s.selected;
+        collapsed    += s.collapsed;
+        no_cost      += s.no_cost;
+        placement_fallback += s.placement_fallback;
+        topology     += s.topology;
+        constraint   += s.constraint;
+        max_cost      = std::max(max_cost, s.max_cost);
+        for (auto i = 0u; i < Bins; i++)
+            histogram[i] += s.histogram[i];
+    }
+
+    // Lower bound of the cost in the given bin.
+    static double BinCost(unsigned bin)
+    {
+        if (bin == 0)
+            return 0.0;
+        return std::pow(10.0, (bin - 1) * 0.5 - 12.0);
+    }
+
+    void Report() const
+    {
+        CLxUser_LogService s_log;
+        CLxUser_Log        log;
+        if (!s_log.GetSubSystem(LXsLOG_LOGSYS, log))
+            return;
+
+        char buf[256];
+        snprintf(buf, sizeof(buf), "Decimate collapse: selected %llu collapsed %llu rejected topology %llu constraint %llu "
+                                   "no cost %llu default placement %llu constrained edges %llu max cost %g%s",
+                 static_cast<unsigned long long>(selected), static_cast<unsigned long long>(collapsed),
+                 static_cast<unsigned long long>(topology), static_cast<unsigned long long>(constraint),
+                 static_cast<unsigned long long>(no_cost), static_cast<unsigned long long>(placement_fallback),
+                 static_cast<unsigned long long>(constrained_edges), max_cost, stop_reached ? " (stopped)" : "");
+        log.Message(LXe_INFO, buf);
+    }
+};
+
+//
+// Cancellation token shared by the caller and a running decimation.
+//
+class CCancelToken
+{
+public:
+    void Cancel() { m_cancelled.store(true); }
+    bool IsCancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> m_cancelled{false};
+};
+
+//
+// Progress callback called with the phase name and the fraction done of the phase. Returning
+// false cancels the decimation.
+//
+typedef std::function<bool(const char* phase, double fraction)> CProgressFunc;
+
+//
+// Fraction of the whole decimation at the fraction done of the phase, which gives each phase
+// its share of one range in the order they run. The collapse takes the rest, and the unknown
+// phases are taken as the collapse.
+//
+static double PhaseProgress(const char* phase, double fraction)
+{
+    static const struct { const char* name; double begin, end; } phases[] = {
+        { "triangulate", 0.00, 0.10 },
+        { "parts",       0.10, 0.15 },
+        { "convert",     0.15, 0.20 },
+        { "constrain",   0.20, 0.30 },
+    };
+    fraction = std::min(std::max(fraction, 0.0), 1.0);
+    for (auto& p : phases)
+    {
+        if (!strcmp(phase, p.name))
+            return p.begin + (p.end - p.begin) * fraction;
+    }
+    return 0.30 + 0.70 * fraction;
+}
+
+//
+// Running decimations by their owners such as mesh layers. Beginning a new job of the owner
+// cancels the previous one, so a superseded evaluation stops at its next check.
+//
+class CDecimateJobs
+{
+public:
+    static CDecimateJobs& Instance()
+    {
+        static CDecimateJobs jobs;
+        return jobs;
+    }
+
+    std::shared_ptr<CCancelToken> Begin(const std::string& owner)
+    {
+        auto token = std::make_shared<CCancelToken>();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& running = m_jobs[owner];
+        if (running)
+            running->Cancel();
+        running = token;
+        return token;
+    }
+
+    void End(const std::string& owner, const std::shared_ptr<CCancelToken>& token)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_jobs.find(owner);
+        if (it != m_jobs.end() && it->second == token)
+            m_jobs.erase(it);
+    }
+
+private:
+    std::map<std::string, std::shared_ptr<CCancelToken>> m_jobs;
+    std::mutex m_mutex;
+};
+
+//
+// Job of the owner registered during the scope.
+//
+class CDecimateJob
+{
+public:
+    CDecimateJob(const std::string& owner)
+        : m_owner(owner), m_token(CDecimateJobs::Instance().Begin(owner)) {}
+
+    ~CDecimateJob()
+    {
+        CDecimateJobs::Instance().End(m_owner, m_token);
+    }
+
+    const std::shared_ptr<CCancelToken>& Token() const { return m_token; }
+
+private:
+    std::string                   m_owner;
+    std::shared_ptr<CCancelToken> m_token;
+};
+
+//
+// Collapse sequence of a reference frame reused for the frames of the same topology. The
+// topology is the one before the merges, so the faces of the merged vertices are rewritten.
+// Each surviving vertex is placed at the centroid of its merged vertices plus the offset of the
+// placement on the reference frame, which is kept in the local frame of the cluster to follow
+// the rotation of deforming parts.
+//
+struct CAnimationSequence
+{
+    std::vector<uint32_t> verts;        // point index of each CMesh vertex
+    std::vector<uint32_t> tris;         // vertex indices and polygon index of each triangle
+    std::vector<uint32_t> survivor;     // surviving vertex index of each vertex
+    std::vector<uint32_t> anchors;      // vertex giving the tangent of the cluster frame, ~0u for world offsets
+    std::vector<double>   offsets;      // placement offset of each vertex from its cluster centroid
+
+    size_t Bytes() const
+    {
+        return sizeof(*this) + sizeof(uint32_t) * (verts.capacity() + tris.capacity() + survivor.capacity() + anchors.capacity()) +
+               sizeof(double) * offsets.capacity();
+    }
+};
 
 struct CDecimate
 {
@@ -46,6 +256,27 @@ struct CDecimate
     int    m_preserveBoundary;
     int    m_preserveMaterial;
     int    m_triple;
+    int    m_threads;   // Number of worker threads, 0 uses the hardware concurrency
+    int    m_collectStats;
+    std::string m_cacheDir; // Directory of the collapse log files, empty to disable them
+
+    int    m_cluster;       // Snap the vertices to a grid before the collapse for huge meshes
+    int    m_tiles;         // Spatial tiles collapsed in parallel before the seam pass, 0 or 1 for none
+    int    m_reorder;       // Build the mesh in Morton order of the positions for the memory locality
+    int    m_background;    // Run the collapse on a worker thread and report progress from the caller
+    int    m_sequence;      // Keep the topology before the merges for MakeSequence
+    double m_timeBudget;    // Wall-clock budget of DecimateMesh in seconds, 0 for no limit
+    int    m_expired;       // The last collapse was stopped by the time budget
+    double m_reached;       // Fraction of the collapses toward the target done by the last collapse
+
+    CProgressFunc                 m_progress;   // progress callback, may be empty
+    std::shared_ptr<CCancelToken> m_cancel;     // cancellation token, may be null
+
+    CCollapseStats m_stats; // collapse statistics when m_collectStats is set
+    std::vector<uint32_t> m_sourceVerts, m_sourceTris;  // topology before the merges when m_sequence is set
+    std::vector<char>     m_ring;   // locked points of the cell by point index in the incremental mode
+    const std::vector<unsigned>* m_polys;   // polygons of the cell by index in the incremental mode, null for the selection
+    CMemoryReport  m_memory; // allocation accounting after each phase
 
     CDecimate()
     {
@@ -53,10 +284,111 @@ struct CDecimate
         m_ratio = 1.0;
         m_count = 0;
         m_triple = 0;
+        m_threads = 0;
+        m_collectStats = 0;
+        m_cluster = 0;
+        m_tiles = 0;
+        m_reorder = 0;
+        m_background = 0;
+        m_sequence = 0;
+        m_polys = nullptr;
+        m_timeBudget = 0.0;
+        m_expired = 0;
+        m_reached = 1.0;
+    }
+
+    //
+    // Report the progress of the phase and return true when the decimation is cancelled.
+    //
+    bool Cancelled(const char* phase, double fraction)
+    {
+        if (m_progress && !m_progress(phase, fraction))
+        {
+            if (!m_cancel)
+                m_cancel = std::make_shared<CCancelToken>();
+            m_cancel->Cancel();
+        }
+        return m_cancel && m_cancel->IsCancelled();
+    }
+
+    //
+    // Write how far the collapse stopped by the time budget got toward the target.
+    //
+    void ReportBudget(size_t initial, size_t edges, size_t target) const
+    {
+        CLxUser_LogService s_log;
+        CLxUser_Log        log;
+        if (!s_log.GetSubSystem(LXsLOG_LOGSYS, log))
+            return;
+
+        char buf[256];
+        snprintf(buf, sizeof(buf), "Decimate time budget %gs expired: %llu of %llu edges (target %llu), %.1f%% of the collapses done",
+                 m_timeBudget, static_cast<unsigned long long>(edges), static_cast<unsigned long long>(initial),
+                 static_cast<unsigned long long>(target), m_reached * 100.0);
+        log.Message(LXe_WARNING, buf);
+    }
+
+    //
+    // Drop the partial mesh of a cancelled decimation, so nothing is applied from it.
+    //
+    LxResult Abort()
+    {
+        m_cmesh.Clear();
+        return LXe_ABORT;
     }
 
     //
     // Collapse edges
     //
     LxResult DecimateMesh (CLxUser_Mesh& base_mesh);
+
+    //
+    // Collapse edges by the collapse log file in m_cacheDir. The log of the whole collapse
+    // sequence is recorded when the file is not found, and a prefix of it is replayed.
+    //
+    LxResult DecimateByLog (CLxUser_Mesh& base_mesh);
+
+    //
+    // Decimate the mesh by Edge-Length cost for the interactive preview, replaying the
+    // collapse sequence kept in memory for the same mesh. Return LXe_NOTFOUND while the
+    // sequence of a new mesh is recorded in the background.
+    //
+    LxResult DecimatePreview (CLxUser_Mesh& base_mesh);
+
+    //
+    // Decimate the indexed mesh of points (x, y, z) and triangles by the ratio of its free
+    // edges for the streaming mode. The open borders stay where they are. The mesh is replaced
+    // with the result, and border is set for the resulting points on the borders. When raw is
+    // given, the ratio counts only the free edges between the raw points.
+    //
+    LxResult DecimateIndexed (std::vector<double>& points, std::vector<uint32_t>& tris, std::vector<char>& border,
+                              const std::vector<char>* raw = nullptr);
+
+    //
+    // Measure the geometric error of the last DecimateMesh for the benchmark.
+    //
+    void     MeasureError (double& max_error, double& rms_error);
+
+    LxResult RecordLog (CLxUser_Mesh& base_mesh, CCollapseLogData& log);
+    void     ReplayLog (const CCollapseLogHeader& header, const CCollapseStep* steps);
+    int      TargetCount (unsigned nedges) const;
+
+    //
+    // Make the collapse sequence of the last DecimateMesh for the following frames. This needs
+    // the topology kept by DecimateMesh with m_sequence set.
+    //
+    LxResult MakeSequence (CAnimationSequence& sequence);
+
+    //
+    // Decimate the mesh by the collapse sequence made on a reference frame of the same topology.
+    // Only the placements are computed from the current positions.
+    //
+    LxResult DecimateBySequence (CLxUser_Mesh& base_mesh, const CAnimationSequence& sequence);
+
+    //
+    // Decimate only the spatial cells of the mesh changed since the last evaluations, and merge
+    // the results of the other cells from the result cache into m_cmesh.m_result. Each changed
+    // cell is decimated alone by the ratio with its ring locked. params is the hash of the options.
+    //
+    LxResult DecimateIncremental (CLxUser_Mesh& base_mesh, uint64_t params);
 };
\ No newline at end of file
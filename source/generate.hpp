@@ -0,0 +1,426 @@
+//
+// Parametric mesh generators for benchmarking the decimation pipeline.
+//
+#pragma once
+
+#include <lxsdk/lx_mesh.hpp>
+#include <lxsdk/lxu_math.hpp>
+#include <lxsdk/lxvmath.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "util.hpp"
+
+namespace MeshGen {
+
+enum Generator : int
+{
+    None    = 0,
+    Sphere  = 1,    // subdivided sphere (pure triangles, closed)
+    Terrain = 2,    // noisy terrain grid (pure quads, open)
+    Kitbash = 3,    // many small disconnected boxes with material tags
+    Slab    = 4,    // concave n-gon CAD slabs
+    Fan     = 5,    // high-valence triangle fans
+    Panel   = 6,    // perforated panels as keyhole polygons with hundreds of holes
+};
+
+static const char* GeneratorName(int gen)
+{
+    switch (gen)
+    {
+        case Sphere:
+            return "sphere";
+        case Terrain:
+            return "terrain";
+        case Kitbash:
+            return "kitbash";
+        case Slab:
+            return "slab";
+        case Fan:
+            return "fan";
+        case Panel:
+            return "panel";
+    }
+    return "none";
+}
+
+//
+// Deterministic value noise in [-1, 1].
+//
+static double Hash(int x, int y)
+{
+    unsigned h = static_cast<unsigned>(x) * 374761393u + static_cast<unsigned>(y) * 668265263u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    h = h ^ (h >> 16);
+    return static_cast<double>(h & 0xffffff) / static_cast<double>(0x7fffff) - 1.0;
+}
+
+static double Noise(double x, double y)
+{
+    int    ix = static_cast<int>(std::floor(x));
+    int    iy = static_cast<int>(std::floor(y));
+    double fx = x - ix;
+    double fy = y - iy;
+    double a  = Hash(ix, iy) * (1.0 - fx) + Hash(ix + 1, iy) * fx;
+    double b  = Hash(ix, iy + 1) * (1.0 - fx) + Hash(ix + 1, iy + 1) * fx;
+    return a * (1.0 - fy) + b * fy;
+}
+
+//
+// Mesh builder which adds selected polygons to the given mesh.
+//
+struct CMeshBuilder
+{
+    CMeshBuilder(CLxUser_Mesh& mesh)
+    {
+        CLxUser_MeshService mesh_svc;
+        m_pick = mesh_svc.SetMode(LXsMARK_SELECT);
+        m_vert.fromMesh(mesh);
+        m_poly.fromMesh(mesh);
+    }
+
+    LXtPointID Point(double x, double y, double z)
+    {
+        LXtVector  pos = { x, y, z };
+        LXtPointID vrt;
+        m_vert.New(pos, &vrt);
+        return vrt;
+    }
+
+    LXtPolygonID Polygon(const LXtPointID* points, unsigned n, const char* material = nullptr)
+    {
+        LXtPolygonID pol;
+        m_poly.New(LXiPTYP_FACE, points, n, 0, &pol);
+        m_poly.Select(pol);
+        m_poly.SetMarks(m_pick);
+        if (material)
+        {
+            CLxUser_StringTag tag;
+            tag.set(m_poly);
+            tag.Set(LXi_PTAG_MATR, material);
+        }
+        return pol;
+    }
+
+    CLxUser_Point   m_vert;
+    CLxUser_Polygon m_poly;
+    LXtMarkMode     m_pick;
+};
+
+//
+// Cube sphere made of 6 * n * n * 2 triangles.
+//
+static void MakeSphere(CLxUser_Mesh& mesh, unsigned size)
+{
+    CMeshBuilder builder(mesh);
+
+    int n = std::max(1, static_cast<int>(std::sqrt(size / 12.0)));
+
+    std::map<std::tuple<int,int,int>, LXtPointID> lattice;
+
+    auto point = [&](int i, int j, int k) {
+        auto key = std::make_tuple(i, j, k);
+        auto it  = lattice.find(key);
+        if (it != lattice.end())
+            return it->second;
+        double x = 2.0 * i / n - 1.0, y = 2.0 * j / n - 1.0, z = 2.0 * k / n - 1.0;
+        double r = std::sqrt(x * x + y * y + z * z);
+        LXtPointID vrt = builder.Point(x / r, y / r, z / r);
+        lattice[key] = vrt;
+        return vrt;
+    };
+
+    // face axis, fixed side and the lattice coordinate of (u, v) on the face.
+    auto corner = [&](int axis, int side, int u, int v) {
+        int c[3];
+        c[axis]           = side;
+        c[(axis + 1) % 3] = u;
+        c[(axis + 2) % 3] = v;
+        return point(c[0], c[1], c[2]);
+    };
+
+    for (auto axis = 0; axis < 3; axis++)
+    {
+        for (auto side : { 0, n })
+        {
+            for (auto u = 0; u < n; u++)
+            {
+                for (auto v = 0; v < n; v++)
+                {
+                    LXtPointID p0 = corner(axis, side, u, v);
+                    LXtPointID p1 = corner(axis, side, u + 1, v);
+                    LXtPointID p2 = corner(axis, side, u + 1, v + 1);
+                    LXtPointID p3 = corner(axis, side, u, v + 1);
+                    LXtPointID t0[3], t1[3];
+                    if (side == n)
+                    {
+                        t0[0] = p0; t0[1] = p1; t0[2] = p2;
+                        t1[0] = p0; t1[1] = p2; t1[2] = p3;
+                    }
+                    else
+                    {
+                        t0[0] = p0; t0[1] = p2; t0[2] = p1;
+                        t1[0] = p0; t1[1] = p3; t1[2] = p2;
+                    }
+                    builder.Polygon(t0, 3);
+                    builder.Polygon(t1, 3);
+                }
+            }
+        }
+    }
+}
+
+//
+// Noisy terrain grid made of n * n quads.
+//
+static void MakeTerrain(CLxUser_Mesh& mesh, unsigned size)
+{
+    CMeshBuilder builder(mesh);
+
+    int n = std::max(1, static_cast<int>(std::sqrt(size / 2.0)));
+
+    std::vector<LXtPointID> grid((n + 1) * (n + 1));
+    for (auto j = 0; j <= n; j++)
+    {
+        for (auto i = 0; i <= n; i++)
+        {
+            double x = static_cast<double>(i) / n;
+            double z = static_cast<double>(j) / n;
+            double y = 0.1 * Noise(x * 8.0, z * 8.0) + 0.02 * Noise(x * 64.0, z * 64.0);
+            grid[j * (n + 1) + i] = builder.Point(x, y, z);
+        }
+    }
+    for (auto j = 0; j < n; j++)
+    {
+        for (auto i = 0; i < n; i++)
+        {
+            LXtPointID quad[4];
+            quad[0] = grid[j * (n + 1) + i];
+            quad[1] = grid[(j + 1) * (n + 1) + i];
+            quad[2] = grid[(j + 1) * (n + 1) + i + 1];
+            quad[3] = grid[j * (n + 1) + i + 1];
+            builder.Polygon(quad, 4);
+        }
+    }
+}
+
+//
+// Many disconnected boxes, each face subdivided into 4 x 4 quads, with alternating materials.
+//
+static void MakeKitbash(CLxUser_Mesh& mesh, unsigned size)
+{
+    CMeshBuilder builder(mesh);
+
+    const int m     = 4;
+    int       count = std::max(1, static_cast<int>(size / (6 * m * m * 2)));
+    int       row   = std::max(1, static_cast<int>(std::cbrt(static_cast<double>(count))) + 1);
+
+    static const char* materials[] = { "Default", "Metal", "Rubber" };
+
+    for (auto b = 0; b < count; b++)
+    {
+        double ox = 3.0 * (b % row) + 0.5 * Hash(b, 0);
+        double oy = 3.0 * ((b / row) % row) + 0.5 * Hash(b, 1);
+        double oz = 3.0 * (b / (row * row)) + 0.5 * Hash(b, 2);
+        double s  = 0.75 + 0.25 * Hash(b, 3);
+
+        std::map<std::tuple<int,int,int>, LXtPointID> lattice;
+        auto point = [&](int i, int j, int k) {
+            auto key = std::make_tuple(i, j, k);
+            auto it  = lattice.find(key);
+            if (it != lattice.end())
+                return it->second;
+            LXtPointID vrt = builder.Point(ox + s * i / m, oy + s * j / m, oz + s * k / m);
+            lattice[key] = vrt;
+            return vrt;
+        };
+        auto corner = [&](int axis, int side, int u, int v) {
+            int c[3];
+            c[axis]           = side;
+            c[(axis + 1) % 3] = u;
+            c[(axis + 2) % 3] = v;
+            return point(c[0], c[1], c[2]);
+        };
+
+        for (auto axis = 0; axis < 3; axis++)
+        {
+            const char* material = materials[(b + axis) % 3];
+            for (auto side : { 0, m })
+            {
+                for (auto u = 0; u < m; u++)
+                {
+                    for (auto v = 0; v < m; v++)
+                    {
+                        LXtPointID quad[4];
+                        quad[0] = corner(axis, side, u, v);
+                        quad[1] = corner(axis, side, u + 1, v);
+                        quad[2] = corner(axis, side, u + 1, v + 1);
+                        quad[3] = corner(axis, side, u, v + 1);
+                        if (side == 0)
+                            std::swap(quad[1], quad[3]);
+                        builder.Polygon(quad, 4, material);
+                    }
+                }
+            }
+        }
+    }
+}
+
+//
+// Concave comb shaped slabs. The top and bottom caps are large concave n-gons.
+//
+static void MakeSlab(CLxUser_Mesh& mesh, unsigned size)
+{
+    CMeshBuilder builder(mesh);
+
+    const int teeth = 32;
+    const int nv    = teeth * 4;
+    int       count = std::max(1, static_cast<int>(size / (4 * nv)));
+    int       row   = std::max(1, static_cast<int>(std::sqrt(static_cast<double>(count))) + 1);
+
+    std::vector<double>     outline;
+    std::vector<LXtPointID> top(nv), bottom(nv);
+
+    // comb outline on XZ plane.
+    for (auto t = 0; t < teeth; t++)
+    {
+        double x0 = static_cast<double>(t) / teeth;
+        double x1 = (t + 0.5) / teeth;
+        double h  = 0.6 + 0.3 * Hash(t, 7);
+        outline.insert(outline.end(), { x0, 0.2, x0, h, x1, h, x1, 0.2 });
+    }
+    outline[0] = 0.0;
+    outline[1] = 0.0;
+    outline[nv * 2 - 2] = 1.0;
+    outline[nv * 2 - 1] = 0.0;
+
+    for (auto s = 0; s < count; s++)
+    {
+        double ox = 1.5 * (s % row);
+        double oz = 1.5 * (s / row);
+        for (auto i = 0; i < nv; i++)
+        {
+            top[i]    = builder.Point(ox + outline[i * 2], 0.05, oz + outline[i * 2 + 1]);
+            bottom[i] = builder.Point(ox + outline[i * 2], 0.0, oz + outline[i * 2 + 1]);
+        }
+        std::vector<LXtPointID> cap(top.rbegin(), top.rend());
+        builder.Polygon(cap.data(), nv);
+        builder.Polygon(bottom.data(), nv);
+        for (auto i = 0; i < nv; i++)
+        {
+            auto j = (i + 1) % nv;
+            LXtPointID quad[4] = { bottom[i], top[i], top[j], bottom[j] };
+            builder.Polygon(quad, 4);
+        }
+    }
+}
+
+//
+// Triangle fans around a single hub vertex with 512 rim vertices each.
+//
+static void MakeFan(CLxUser_Mesh& mesh, unsigned size)
+{
+    CMeshBuilder builder(mesh);
+
+    const int    valence = 512;
+    const double pi      = 3.14159265358979323846;
+    int          count   = std::max(1, static_cast<int>(size / valence));
+    int          row     = std::max(1, static_cast<int>(std::sqrt(static_cast<double>(count))) + 1);
+
+    std::vector<LXtPointID> rim(valence);
+    for (auto f = 0; f < count; f++)
+    {
+        double ox = 2.5 * (f % row);
+        double oz = 2.5 * (f / row);
+        LXtPointID hub = builder.Point(ox, 0.2, oz);
+        for (auto i = 0; i < valence; i++)
+        {
+            double a = 2.0 * pi * i / valence;
+            rim[i] = builder.Point(ox + std::cos(a), 0.0, oz - std::sin(a));
+        }
+        for (auto i = 0; i < valence; i++)
+        {
+            LXtPointID tri[3] = { hub, rim[i], rim[(i + 1) % valence] };
+            builder.Polygon(tri, 3);
+        }
+    }
+}
+
+//
+// Perforated panels on XZ plane. Each panel is one keyhole polygon bridging 16 x 16 octagonal
+// holes into the outer rectangle by MeshUtil::MakeKeyhole.
+//
+static void MakePanel(CLxUser_Mesh& mesh, unsigned size)
+{
+    CMeshBuilder builder(mesh);
+
+    const int    grid  = 16;
+    const int    sides = 8;
+    const double pi    = 3.14159265358979323846;
+    int          count = std::max(1, static_cast<int>(size / (grid * grid * (sides + 2))));
+    int          row   = std::max(1, static_cast<int>(std::sqrt(static_cast<double>(count))) + 1);
+
+    AxisPlane axisPlane(1u);
+
+    std::vector<LXtPointID>              outer(4), keyhole;
+    std::vector<std::vector<LXtPointID>> holes(grid * grid, std::vector<LXtPointID>(sides));
+    for (auto p = 0; p < count; p++)
+    {
+        double ox = 1.5 * (p % row);
+        double oz = 1.5 * (p / row);
+
+        // The holes wind opposite to the outline.
+        outer[0] = builder.Point(ox, 0.0, oz);
+        outer[1] = builder.Point(ox, 0.0, oz + 1.0);
+        outer[2] = builder.Point(ox + 1.0, 0.0, oz + 1.0);
+        outer[3] = builder.Point(ox + 1.0, 0.0, oz);
+        for (auto h = 0; h < grid * grid; h++)
+        {
+            double cx = ox + (h % grid + 0.5) / grid;
+            double cz = oz + (h / grid + 0.5) / grid;
+            double r  = (0.25 + 0.1 * Hash(h, p)) / grid;
+            for (auto k = 0; k < sides; k++)
+            {
+                double a = 2.0 * pi * k / sides;
+                holes[h][k] = builder.Point(cx + r * std::cos(a), 0.0, cz + r * std::sin(a));
+            }
+        }
+        MeshUtil::MakeKeyhole(mesh, axisPlane, outer, holes, keyhole);
+        builder.Polygon(keyhole.data(), static_cast<unsigned>(keyhole.size()));
+    }
+}
+
+//
+// Generate the mesh with approximately the given number of triangles.
+//
+static bool Generate(CLxUser_Mesh& mesh, int gen, unsigned size)
+{
+    switch (gen)
+    {
+        case Sphere:
+            MakeSphere(mesh, size);
+            return true;
+        case Terrain:
+            MakeTerrain(mesh, size);
+            return true;
+        case Kitbash:
+            MakeKitbash(mesh, size);
+            return true;
+        case Slab:
+            MakeSlab(mesh, size);
+            return true;
+        case Fan:
+            MakeFan(mesh, size);
+            return true;
+        case Panel:
+            MakePanel(mesh, size);
+            return true;
+    }
+    return false;
+}
+
+}; // MeshGen
@@ -0,0 +1,324 @@
+//
+// Split of the input mesh into spatial cells for the incremental decimation. The selected
+// surface polygons are bucketed into the cells of a grid by their centroids. The points shared
+// by the polygons of different cells make the ring of each cell, which is locked during the
+// decimation of the cell, so the cells are decimated one by one and still meet exactly.
+//
+#pragma once
+
+#include <lxsdk/lx_mesh.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "cache.hpp"
+
+struct CMeshCell
+{
+    std::vector<unsigned> polys;    // polygon indices in ascending order
+    std::vector<unsigned> points;   // point indices in the order of the first appearance
+    std::vector<unsigned> ring;     // local indices of the points shared with the other cells
+    uint64_t              hash = 0; // content hash invariant to the indices out of the cell
+};
+
+struct CMeshCells
+{
+    static const unsigned None = ~0u;
+
+    // Polygons per cell the grid is sized for.
+    static const unsigned CellPolygons = 65536;
+
+    std::vector<CMeshCell> cells;
+    std::vector<unsigned>  poly_cell;    // cell of each polygon, or None
+    std::vector<unsigned>  poly_local;   // index of each polygon in its cell
+    unsigned               npoints = 0;  // point count of the mesh
+
+    //
+    // Bucket the polygons into the cells and hash their contents. The cell size is a power of
+    // two and the grid is anchored at the origin, so an edit keeps the cells of the polygons
+    // it does not touch. The vertex lists, locked edges and the ring are hashed by the point
+    // indices local to the cell.
+    //
+    LxResult Split(CLxUser_Mesh& mesh)
+    {
+        PROFILE_SCOPE("incremental.split");
+        CLxUser_MeshService mesh_svc;
+        LXtMarkMode pick = mesh_svc.SetMode(LXsMARK_SELECT);
+        LXtMarkMode hide = mesh_svc.SetMode(LXsMARK_HIDE);
+        LXtMarkMode lock = mesh_svc.SetMode(LXsMARK_LOCK);
+
+        CLxUser_Point   vert;
+        CLxUser_Polygon poly;
+        CLxUser_Edge    edge;
+        vert.fromMesh(mesh);
+        poly.fromMesh(mesh);
+        edge.fromMesh(mesh);
+
+        unsigned npol = 0;
+        mesh.PointCount(&npoints);
+        mesh.PolygonCount(&npol);
+
+        cells.clear();
+        poly_cell.assign(npol, None);
+        poly_local.assign(npol, None);
+
+        // Vertex lists of the target polygons by point indices.
+        std::vector<unsigned> starts(npol + 1, 0);
+        std::vector<unsigned> indices;
+        unsigned              ntargets = 0;
+        for (auto i = 0u; i < npol; i++)
+        {
+            starts[i] = static_cast<unsigned>(indices.size());
+            poly.SelectByIndex(i);
+            if (poly.TestMarks(pick) != LXe_TRUE)
+                continue;
+            LXtID4   type;
+            unsigned nvert;
+            poly.Type(&type);
+            poly.VertexCount(&nvert);
+            if ((type != LXiPTYP_FACE) && (type != LXiPTYP_PSUB) && (type != LXiPTYP_SUBD))
+                continue;
+            if (nvert < 3)
+                continue;
+            for (auto j = 0u; j < nvert; j++)
+            {
+                LXtPointID vrt;
+                unsigned   index;
+                poly.VertexByIndex(j, &vrt);
+                vert.Select(vrt);
+                vert.Index(&index);
+                indices.push_back(index);
+            }
+            poly_cell[i] = 0;
+            ntargets ++;
+        }
+        starts[npol] = static_cast<unsigned>(indices.size());
+        if (!ntargets)
+            return LXe_OK;
+
+        std::vector<double> pos(static_cast<size_t>(npoints) * 3);
+        for (auto i = 0u; i < npoints; i++)
+        {
+            LXtFVector fpos;
+            vert.SelectByIndex(i);
+            vert.Pos(fpos);
+            for (auto k = 0u; k < 3; k++)
+                pos[i * 3 + k] = fpos[k];
+        }
+        double lo[3], hi[3];
+        for (auto k = 0u; k < 3; k++)
+            lo[k] = hi[k] = pos[indices[0] * 3 + k];
+        for (auto index : indices)
+        {
+            for (auto k = 0u; k < 3; k++)
+            {
+                lo[k] = std::min(lo[k], pos[index * 3 + k]);
+                hi[k] = std::max(hi[k], pos[index * 3 + k]);
+            }
+        }
+
+        // A surface spreads the polygons on two dimensions, so the cell edge is the extent
+        // scaled by the square root of the cell share, rounded up to a power of two.
+        double extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+        double size   = extent * std::sqrt(static_cast<double>(CellPolygons) / ntargets);
+        size = (size > 0.0) ? std::exp2(std::ceil(std::log2(size))) : 1.0;
+
+        // Number the cells by their first polygons.
+        std::map<std::tuple<int64_t,int64_t,int64_t>,unsigned> cell_index;
+        for (auto i = 0u; i < npol; i++)
+        {
+            if (poly_cell[i] == None)
+                continue;
+            double c[3] = { 0.0, 0.0, 0.0 };
+            for (auto j = starts[i]; j < starts[i + 1]; j++)
+            {
+                for (auto k = 0u; k < 3; k++)
+                    c[k] += pos[indices[j] * 3 + k];
+            }
+            double n = static_cast<double>(starts[i + 1] - starts[i]);
+            auto   key = std::make_tuple(static_cast<int64_t>(std::floor(c[0] / n / size)),
+                                         static_cast<int64_t>(std::floor(c[1] / n / size)),
+                                         static_cast<int64_t>(std::floor(c[2] / n / size)));
+            auto it = cell_index.find(key);
+            if (it == cell_index.end())
+            {
+                it = cell_index.emplace(key, static_cast<unsigned>(cells.size())).first;
+                cells.emplace_back();
+            }
+            CMeshCell& cell = cells[it->second];
+            poly_cell[i]  = it->second;
+            poly_local[i] = static_cast<unsigned>(cell.polys.size());
+            cell.polys.push_back(i);
+        }
+
+        // The points of each cell, and the first cell of each point to find the shared ones.
+        std::vector<unsigned> first_cell(npoints, None);
+        std::vector<char>     shared(npoints, 0);
+        for (auto i = 0u; i < npol; i++)
+        {
+            if (poly_cell[i] == None)
+                continue;
+            for (auto j = starts[i]; j < starts[i + 1]; j++)
+            {
+                unsigned index = indices[j];
+                if (first_cell[index] == None)
+                    first_cell[index] = poly_cell[i];
+                else if (first_cell[index] != poly_cell[i])
+                    shared[index] = 1;
+            }
+        }
+
+        std::vector<unsigned> local(npoints, None);
+        CLxUser_StringTag     tag;
+        for (auto& cell : cells)
+        {
+            for (auto i : cell.polys)
+            {
+                for (auto j = starts[i]; j < starts[i + 1]; j++)
+                {
+                    unsigned index = indices[j];
+                    if (local[index] != None)
+                        continue;
+                    local[index] = static_cast<unsigned>(cell.points.size());
+                    cell.points.push_back(index);
+                    if (shared[index])
+                        cell.ring.push_back(local[index]);
+                }
+            }
+
+            CContentHash hash;
+            hash.Add(cell.points.size());
+            hash.Add(cell.polys.size());
+            for (auto index : cell.points)
+                hash.Add(&pos[index * 3], sizeof(double) * 3);
+            for (auto index : cell.ring)
+                hash.Add(index);
+            for (auto i : cell.polys)
+            {
+                LXtID4   type;
+                unsigned marks = 0, nvert = starts[i + 1] - starts[i];
+                poly.SelectByIndex(i);
+                poly.Type(&type);
+                hash.Add(type);
+                hash.Add(nvert);
+                for (auto j = starts[i]; j < starts[i + 1]; j++)
+                    hash.Add(local[indices[j]]);
+                if (poly.TestMarks(hide) == LXe_TRUE)
+                    marks |= 2;
+                if (poly.TestMarks(lock) == LXe_TRUE)
+                    marks |= 4;
+                hash.Add(marks);
+                tag.set(poly);
+                hash.Add(tag.Value(LXi_PTAG_MATR));
+
+                for (auto j = 0u; j < nvert; j++)
+                {
+                    LXtPointID v0, v1;
+                    poly.VertexByIndex(j, &v0);
+                    poly.VertexByIndex((j + 1) % nvert, &v1);
+                    if (edge.SelectEndpoints(v0, v1) != LXe_OK || edge.TestMarks(lock) != LXe_TRUE)
+                        continue;
+                    hash.Add(j);
+                }
+            }
+            cell.hash = hash.value;
+
+            for (auto index : cell.points)
+                local[index] = None;
+        }
+        return LXe_OK;
+    }
+
+    //
+    // Set the marks of the ring points of the cell by point index. The marks are sized for the
+    // points of the mesh once, and each cell sets and resets only its ring.
+    //
+    void MarkRing(unsigned index, std::vector<char>& ring, char value) const
+    {
+        const CMeshCell& cell = cells[index];
+        for (auto i : cell.ring)
+            ring[cell.points[i]] = value;
+    }
+
+    //
+    // Convert the result of the decimation of the cell alone into its local indices.
+    //
+    std::shared_ptr<CDecimateResult> LocalResult(const CDecimateResult& result, unsigned index) const
+    {
+        const CMeshCell& cell = cells[index];
+        std::unordered_map<unsigned,unsigned> point_local;
+        point_local.reserve(cell.points.size());
+        for (auto i = 0u; i < cell.points.size(); i++)
+            point_local[cell.points[i]] = i;
+
+        auto local = std::make_shared<CDecimateResult>();
+        local->npoints   = static_cast<unsigned>(cell.points.size());
+        local->npolygons = static_cast<unsigned>(cell.polys.size());
+        local->face_starts.push_back(0);
+
+        for (auto i : result.removed_points)
+            local->removed_points.push_back(point_local[i]);
+        for (auto i = 0u; i < result.moved_points.size(); i++)
+        {
+            local->moved_points.push_back(point_local[result.moved_points[i]]);
+            local->positions.insert(local->positions.end(), &result.positions[i * 3], &result.positions[i * 3 + 3]);
+        }
+        for (auto i = 0u; i < result.face_polys.size(); i++)
+        {
+            local->face_polys.push_back(poly_local[result.face_polys[i]]);
+            for (auto j = result.face_starts[i]; j < result.face_starts[i + 1]; j++)
+                local->face_points.push_back(point_local[result.face_points[j]]);
+            local->face_starts.push_back(static_cast<unsigned>(local->face_points.size()));
+        }
+        for (auto i : result.new_tris)
+            local->new_tris.push_back(point_local[i]);
+        for (auto i : result.new_tri_polys)
+            local->new_tri_polys.push_back(poly_local[i]);
+        for (auto i : result.removed_polys)
+            local->removed_polys.push_back(poly_local[i]);
+
+        unsigned touched = static_cast<unsigned>(local->face_polys.size() + local->removed_polys.size());
+        local->unchanged = local->npolygons > touched ? local->npolygons - touched : 0;
+        return local;
+    }
+
+    //
+    // Merge the results of all cells by their local indices into the result of the mesh.
+    //
+    void MergeResults(const std::vector<std::shared_ptr<const CDecimateResult>>& locals, CDecimateResult& result) const
+    {
+        result.Clear();
+        result.npoints   = npoints;
+        result.npolygons = static_cast<unsigned>(poly_cell.size());
+        result.face_starts.push_back(0);
+        for (auto i = 0u; i < cells.size(); i++)
+        {
+            const CMeshCell&       cell  = cells[i];
+            const CDecimateResult& local = *locals[i];
+            result.unchanged += local.unchanged;
+            for (auto index : local.removed_points)
+                result.removed_points.push_back(cell.points[index]);
+            for (auto index : local.moved_points)
+                result.moved_points.push_back(cell.points[index]);
+            result.positions.insert(result.positions.end(), local.positions.begin(), local.positions.end());
+            for (auto j = 0u; j < local.face_polys.size(); j++)
+            {
+                result.face_polys.push_back(cell.polys[local.face_polys[j]]);
+                for (auto k = local.face_starts[j]; k < local.face_starts[j + 1]; k++)
+                    result.face_points.push_back(cell.points[local.face_points[k]]);
+                result.face_starts.push_back(static_cast<unsigned>(result.face_points.size()));
+            }
+            for (auto index : local.new_tris)
+                result.new_tris.push_back(cell.points[index]);
+            for (auto index : local.new_tri_polys)
+                result.new_tri_polys.push_back(cell.polys[index]);
+            for (auto index : local.removed_polys)
+                result.removed_polys.push_back(cell.polys[index]);
+        }
+    }
+};
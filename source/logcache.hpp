@@ -0,0 +1,286 @@
+//
+// On-disk cache of the triangulated topology and the collapse sequence of a mesh.
+//
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//
+// One edge collapse of the sequence. v1 is merged into v0 when forward is set, otherwise v0
+// into v1, and the surviving vertex is placed at pos. edges is the edge count when the edge
+// was selected, which the edge count stop predicate is tested with.
+//
+struct CCollapseStep
+{
+    uint32_t v0, v1;
+    uint32_t forward;
+    uint32_t edges;
+    double   pos[3];
+};
+
+//
+// File header followed by the vertex, triangle and collapse step arrays.
+//
+struct CCollapseLogHeader
+{
+    static const uint32_t Magic   = 0x474C4344;   // "DCLG"
+    static const uint32_t Version = 1;
+
+    uint32_t magic     = Magic;
+    uint32_t version   = Version;
+    uint64_t key       = 0;     // content hash of the mesh and the collapse parameters
+    uint32_t npoints   = 0;     // point count of the base mesh
+    uint32_t npolygons = 0;     // polygon count of the base mesh
+    uint32_t nverts    = 0;     // CMesh vertices: point index
+    uint32_t ntris     = 0;     // CMesh triangles: vertex indices and polygon index
+    uint32_t nsteps    = 0;     // collapse steps
+    uint32_t nedges    = 0;     // edge count of the surface mesh before the collapse
+
+    // The steps are aligned to 8 bytes for the positions.
+    size_t StepsOffset() const
+    {
+        size_t offset = sizeof(CCollapseLogHeader) + sizeof(uint32_t) * (nverts + ntris * 4);
+        return (offset + 7) & ~size_t(7);
+    }
+
+    size_t FileSize() const
+    {
+        return StepsOffset() + sizeof(CCollapseStep) * nsteps;
+    }
+};
+
+//
+// Collapse log kept in memory.
+//
+struct CCollapseLogData
+{
+    CCollapseLogHeader         header;
+    std::vector<uint32_t>      verts;
+    std::vector<uint32_t>      tris;
+    std::vector<CCollapseStep> steps;
+
+    size_t Bytes() const
+    {
+        return sizeof(*this) + sizeof(uint32_t) * (verts.capacity() + tris.capacity()) + sizeof(CCollapseStep) * steps.capacity();
+    }
+};
+
+//
+// Read-only memory mapping of a file.
+//
+class CMappedFile
+{
+public:
+    ~CMappedFile()
+    {
+        Close();
+    }
+
+    bool Open(const std::string& path)
+    {
+        Close();
+#if defined(_WIN32)
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+        {
+            Close();
+            return false;
+        }
+        m_size = static_cast<size_t>(size.QuadPart);
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping)
+        {
+            Close();
+            return false;
+        }
+        m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        m_fd = open(path.c_str(), O_RDONLY);
+        if (m_fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(m_fd, &st) != 0 || st.st_size == 0)
+        {
+            Close();
+            return false;
+        }
+        m_size = static_cast<size_t>(st.st_size);
+        m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (m_data == MAP_FAILED)
+            m_data = nullptr;
+#endif
+        if (!m_data)
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+#if defined(_WIN32)
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+        m_mapping = nullptr;
+        m_file    = INVALID_HANDLE_VALUE;
+#else
+        if (m_data)
+            munmap(m_data, m_size);
+        if (m_fd >= 0)
+            close(m_fd);
+        m_fd = -1;
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const unsigned char* Data() const { return static_cast<const unsigned char*>(m_data); }
+    size_t Size() const { return m_size; }
+
+private:
+    void*  m_data = nullptr;
+    size_t m_size = 0;
+#if defined(_WIN32)
+    HANDLE m_file    = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int    m_fd = -1;
+#endif
+};
+
+//
+// Collapse log file. The arrays are used in place from the mapped file.
+//
+class CCollapseLogFile
+{
+public:
+    static std::string Path(const std::string& dir, uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.dclog", static_cast<unsigned long long>(key));
+        if (dir.empty() || dir.back() == '/' || dir.back() == '\\')
+            return dir + name;
+        return dir + "/" + name;
+    }
+
+    //
+    // Map the file and validate it for the given key and mesh counts.
+    //
+    bool Open(const std::string& path, uint64_t key, unsigned npoints, unsigned npolygons)
+    {
+        if (!m_file.Open(path))
+            return false;
+        if (m_file.Size() < sizeof(CCollapseLogHeader))
+            return Fail();
+        std::memcpy(&m_header, m_file.Data(), sizeof(CCollapseLogHeader));
+        if (m_header.magic != CCollapseLogHeader::Magic || m_header.version != CCollapseLogHeader::Version)
+            return Fail();
+        if (m_header.key != key || m_header.npoints != npoints || m_header.npolygons != npolygons)
+            return Fail();
+        if (m_header.FileSize() != m_file.Size())
+            return Fail();
+        return true;
+    }
+
+    //
+    // Write the file into a temporary file and move it to the path, so a partial file is never
+    // read by another process. The temporary name is unique to the process and the call, so
+    // concurrent writers of the same path do not write into one file.
+    //
+    static bool Write(const std::string& path, CCollapseLogHeader header, const std::vector<uint32_t>& verts,
+                      const std::vector<uint32_t>& tris, const std::vector<CCollapseStep>& steps)
+    {
+        header.nverts = static_cast<uint32_t>(verts.size());
+        header.ntris  = static_cast<uint32_t>(tris.size() / 4);
+        header.nsteps = static_cast<uint32_t>(steps.size());
+
+        static std::atomic<unsigned> serial{0};
+#if defined(_WIN32)
+        unsigned long pid = GetCurrentProcessId();
+#else
+        unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), ".%lu.%u.tmp", pid, serial++);
+        std::string temp = path + suffix;
+        FILE* fp = fopen(temp.c_str(), "wb");
+        if (!fp)
+            return false;
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+        if (ok && !verts.empty())
+            ok = fwrite(verts.data(), sizeof(uint32_t), verts.size(), fp) == verts.size();
+        if (ok && !tris.empty())
+            ok = fwrite(tris.data(), sizeof(uint32_t), tris.size(), fp) == tris.size();
+        size_t padding = header.StepsOffset() - sizeof(header) - sizeof(uint32_t) * (verts.size() + tris.size());
+        static const char zeros[8] = {};
+        if (ok && padding > 0)
+            ok = fwrite(zeros, 1, padding, fp) == padding;
+        if (ok && !steps.empty())
+            ok = fwrite(steps.data(), sizeof(CCollapseStep), steps.size(), fp) == steps.size();
+        if (fclose(fp) != 0)
+            ok = false;
+        if (ok)
+        {
+#if defined(_WIN32)
+            ok = MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+            ok = std::rename(temp.c_str(), path.c_str()) == 0;
+#endif
+        }
+        if (!ok)
+            std::remove(temp.c_str());
+        return ok;
+    }
+
+    const CCollapseLogHeader& Header() const { return m_header; }
+
+    const uint32_t* Vertices() const
+    {
+        return reinterpret_cast<const uint32_t*>(m_file.Data() + sizeof(CCollapseLogHeader));
+    }
+
+    const uint32_t* Triangles() const
+    {
+        return Vertices() + m_header.nverts;
+    }
+
+    const CCollapseStep* Steps() const
+    {
+        return reinterpret_cast<const CCollapseStep*>(m_file.Data() + m_header.StepsOffset());
+    }
+
+private:
+    bool Fail()
+    {
+        m_file.Close();
+        return false;
+    }
+
+    CMappedFile        m_file;
+    CCollapseLogHeader m_header;
+};
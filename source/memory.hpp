@@ -0,0 +1,182 @@
+//
+// Allocation accounting of the decimation pipeline per subsystem.
+//
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+//
+// Subsystems of which allocations are accounted.
+//
+enum MemoryPool : unsigned
+{
+    MP_CMesh = 0,       // CMesh vertices, edges, triangles, faces and parts
+    MP_SurfaceMesh,     // CGAL Surface_mesh (estimated from its element counts)
+    MP_Constraints,     // constrained edge map
+    MP_CollapseLog,     // collapse log recorded by the visitor
+    MP_Count
+};
+
+//
+// Usage of one pool at a moment.
+//
+struct CMemoryUsage
+{
+    int64_t bytes = 0;      // live bytes
+    int64_t count = 0;      // live allocations
+    int64_t peak  = 0;      // high-water mark of live bytes since the last ResetPeak
+};
+
+//
+// Usage of all pools at a moment.
+//
+struct CMemorySnapshot
+{
+    CMemoryUsage pool[MP_Count];
+    int64_t      peak = 0;  // high-water mark of the live bytes of all pools together
+
+    static const char* Name(unsigned i)
+    {
+        static const char* names[MP_Count] = { "CMesh", "SurfaceMesh", "Constraints", "CollapseLog" };
+        return names[i];
+    }
+
+    int64_t Bytes() const
+    {
+        int64_t total = 0;
+        for (auto& p : pool)
+            total += p.bytes;
+        return total;
+    }
+
+    // The pools peak at different times, so this is not the sum of their peaks.
+    int64_t Peak() const
+    {
+        return peak;
+    }
+};
+
+//
+// Memory usage after each phase of the last evaluation.
+//
+struct CMemoryReport
+{
+    CMemorySnapshot build;      // after BuildMesh
+    CMemorySnapshot convert;    // after ConvertToCGALMesh
+    CMemorySnapshot decimate;   // after DecimateMesh
+};
+
+//
+// Process wide allocation counters. The counters are shared by all evaluations, so the
+// numbers of concurrent evaluations are mixed.
+//
+class CMemoryTracker
+{
+public:
+    static CMemoryTracker& Get()
+    {
+        static CMemoryTracker tracker;
+        return tracker;
+    }
+
+    void Allocate(unsigned pool, size_t bytes)
+    {
+        Counter& c = m_pool[pool];
+        int64_t  n = c.bytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) + static_cast<int64_t>(bytes);
+        c.count.fetch_add(1, std::memory_order_relaxed);
+        Raise(c.peak, n);
+        Raise(m_peak, m_bytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) + static_cast<int64_t>(bytes));
+    }
+
+    void Deallocate(unsigned pool, size_t bytes)
+    {
+        Counter& c = m_pool[pool];
+        c.bytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+        c.count.fetch_sub(1, std::memory_order_relaxed);
+        m_bytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+    }
+
+    //
+    // Restart the high-water marks from the current usage.
+    //
+    void ResetPeak()
+    {
+        for (auto& c : m_pool)
+            c.peak.store(c.bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_peak.store(m_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    CMemorySnapshot Snapshot() const
+    {
+        CMemorySnapshot snap;
+        for (auto i = 0u; i < MP_Count; i++)
+        {
+            snap.pool[i].bytes = m_pool[i].bytes.load(std::memory_order_relaxed);
+            snap.pool[i].count = m_pool[i].count.load(std::memory_order_relaxed);
+            snap.pool[i].peak  = m_pool[i].peak.load(std::memory_order_relaxed);
+        }
+        snap.peak = m_peak.load(std::memory_order_relaxed);
+        return snap;
+    }
+
+private:
+    static void Raise(std::atomic<int64_t>& peak, int64_t n)
+    {
+        int64_t value = peak.load(std::memory_order_relaxed);
+        while (n > value && !peak.compare_exchange_weak(value, n, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    struct Counter
+    {
+        std::atomic<int64_t> bytes{0};
+        std::atomic<int64_t> count{0};
+        std::atomic<int64_t> peak{0};
+    };
+
+    Counter              m_pool[MP_Count];
+    std::atomic<int64_t> m_bytes{0};    // live bytes of all pools
+    std::atomic<int64_t> m_peak{0};     // high-water mark of m_bytes since the last ResetPeak
+};
+
+//
+// Standard allocator accounting its allocations into the given pool.
+//
+template <typename T, unsigned Pool>
+struct CountingAllocator
+{
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef CountingAllocator<U, Pool> other;
+    };
+
+    CountingAllocator() noexcept {}
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U, Pool>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        CMemoryTracker::Get().Allocate(Pool, n * sizeof(T));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        CMemoryTracker::Get().Deallocate(Pool, n * sizeof(T));
+        ::operator delete(p);
+    }
+};
+
+template <typename T, typename U, unsigned Pool>
+bool operator==(const CountingAllocator<T, Pool>&, const CountingAllocator<U, Pool>&) { return true; }
+
+template <typename T, typename U, unsigned Pool>
+bool operator!=(const CountingAllocator<T, Pool>&, const CountingAllocator<U, Pool>&) { return false; }
@@ -0,0 +1,280 @@
+//
+// Phase timing of the decimation pipeline.
+//
+#pragma once
+
+#include <chrono>
+
+//
+// Elapsed time in milliseconds of each phase of the last evaluation.
+//
+struct CPhaseTimes
+{
+    double triangulate = 0.0;   // polygon triangulation in BuildMesh
+    double parts       = 0.0;   // connected part detection in BuildMesh
+    double reorder     = 0.0;   // spatial reordering of the vertices and triangles in BuildMesh
+    double cluster     = 0.0;   // vertex clustering before the collapse
+    double convert     = 0.0;   // CMesh to CGAL Surface_mesh conversion
+    double constrain   = 0.0;   // constrained edge classification
+    double collapse    = 0.0;   // SMS::edge_collapse
+    double replay      = 0.0;   // collapse replay into CMesh
+    double writeback   = 0.0;   // ApplyMesh or WriteMesh
+
+    static const unsigned Count = 9;
+
+    static const char* Name(unsigned i)
+    {
+        static const char* names[Count] = {
+            "triangulate", "parts", "reorder", "cluster", "convert", "constrain", "collapse", "replay", "writeback"
+        };
+        return names[i];
+    }
+
+    double& Phase(unsigned i)
+    {
+        switch (i)
+        {
+            case 0:  return triangulate;
+            case 1:  return parts;
+            case 2:  return reorder;
+            case 3:  return cluster;
+            case 4:  return convert;
+            case 5:  return constrain;
+            case 6:  return collapse;
+            case 7:  return replay;
+        }
+        return writeback;
+    }
+
+    double Phase(unsigned i) const
+    {
+        return const_cast<CPhaseTimes*>(this)->Phase(i);
+    }
+
+    void Clear()
+    {
+        *this = CPhaseTimes();
+    }
+
+    double Total() const
+    {
+        return triangulate + parts + reorder + cluster + convert + constrain + collapse + replay + writeback;
+    }
+};
+
+//
+// Wall clock stopwatch returning milliseconds.
+//
+struct CStopwatch
+{
+    CStopwatch()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        m_start = std::chrono::steady_clock::now();
+    }
+
+    double Elapsed() const
+    {
+        auto d = std::chrono::steady_clock::now() - m_start;
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+    std::chrono::steady_clock::time_point m_start;
+};
+
+//
+// Scoped timers and counters for tracing the evaluation. They are compiled in only when
+// DECIMATE_PROFILE is defined, otherwise the macros below expand to nothing.
+//
+enum ProfileCounter : unsigned
+{
+    PC_Polygons = 0,        // source polygons
+    PC_Triangles,           // triangles built from the source polygons
+    PC_Vertices,            // vertices of the triangles
+    PC_Parts,               // connected parts
+    PC_Edges,               // edges in CGAL mesh
+    PC_ConstrainedEdges,    // edges locked for edge_collapse
+    PC_CollapsedEdges,      // edges removed by edge_collapse
+    PC_RejectedCollapses,   // collapses rejected by the topology test
+    PC_CDTFallbacks,        // polygons failed in constrained Delaunay triangulation
+    PC_ConvexPolygons,      // convex n-gons triangulated by fan without constrained Delaunay
+    PC_FanFallbacks,        // polygons failed in ear clipping after constrained Delaunay
+    PC_WrittenElements,     // vertices and polygons written by ApplyMesh
+    PC_ClusteredVertices,   // vertices merged by the vertex clustering
+    PC_CDTExceptions,       // CGAL exceptions caught in constrained Delaunay triangulation
+    PC_RejectedFaces,       // triangles rejected by Surface_mesh and kept by their vertices
+    PC_Count
+};
+
+#ifdef DECIMATE_PROFILE
+
+#include <lxsdk/lx_log.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CProfiler
+{
+public:
+    struct Event
+    {
+        const char* name;
+        double      start;      // microseconds from the profiler epoch
+        double      duration;   // microseconds
+        size_t      thread;
+    };
+
+    static CProfiler& Get()
+    {
+        static CProfiler profiler;
+        return profiler;
+    }
+
+    static const char* CounterName(unsigned i)
+    {
+        static const char* names[PC_Count] = {
+            "polygons", "triangles", "vertices", "parts", "edges",
+            "constrained edges", "collapsed edges", "rejected collapses", "CDT fallbacks",
+            "convex fans", "fan fallbacks", "written elements", "clustered vertices",
+            "CDT exceptions", "rejected faces"
+        };
+        return names[i];
+    }
+
+    //
+    // Reset the counters and the events at the beginning of an evaluation.
+    //
+    void Begin()
+    {
+        for (auto& counter : m_counters)
+            counter = 0;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_events.clear();
+    }
+
+    void Count(unsigned counter, uint64_t n)
+    {
+        m_counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    double Now() const
+    {
+        auto d = std::chrono::steady_clock::now() - m_epoch;
+        return std::chrono::duration<double, std::micro>(d).count();
+    }
+
+    double Since(std::chrono::steady_clock::time_point t) const
+    {
+        return std::chrono::duration<double, std::micro>(t - m_epoch).count();
+    }
+
+    void Record(const char* name, double start, double end)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_events.size() >= MaxEvents)
+            return;
+        m_events.push_back({ name, start, end - start, std::hash<std::thread::id>()(std::this_thread::get_id()) });
+    }
+
+    //
+    // Write the summary of the evaluation to the event log. When DECIMATE_TRACE environment
+    // variable is set, the events of the evaluation are written to the file in Chrome trace format.
+    //
+    void Report(const CPhaseTimes& times)
+    {
+        std::string text = "Decimate:";
+        char        buf[128];
+        for (auto i = 0u; i < CPhaseTimes::Count; i++)
+        {
+            snprintf(buf, sizeof(buf), " %s %.2f ms", CPhaseTimes::Name(i), times.Phase(i));
+            text += buf;
+        }
+        for (auto i = 0u; i < PC_Count; i++)
+        {
+            snprintf(buf, sizeof(buf), ", %s %llu", CounterName(i), static_cast<unsigned long long>(m_counters[i].load()));
+            text += buf;
+        }
+
+        CLxUser_LogService s_log;
+        CLxUser_Log        log;
+        if (s_log.GetSubSystem(LXsLOG_LOGSYS, log))
+            log.Message(LXe_INFO, text.c_str());
+
+        const char* filename = std::getenv("DECIMATE_TRACE");
+        if (filename)
+            WriteTrace(filename);
+    }
+
+    void WriteTrace(const char* filename)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        FILE* fp = fopen(filename, "w");
+        if (!fp)
+            return;
+        fprintf(fp, "[\n");
+        for (auto i = 0u; i < m_events.size(); i++)
+        {
+            const Event& e = m_events[i];
+            fprintf(fp, "  { \"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %zu }%s\n",
+                    e.name, e.start, e.duration, e.thread % 100000, (i + 1 < m_events.size()) ? "," : "");
+        }
+        fprintf(fp, "]\n");
+        fclose(fp);
+    }
+
+private:
+    CProfiler() : m_epoch(std::chrono::steady_clock::now())
+    {
+        Begin();
+    }
+
+    static const size_t MaxEvents = 1 << 20;
+
+    std::chrono::steady_clock::time_point m_epoch;
+    std::atomic<uint64_t>                 m_counters[PC_Count];
+    std::vector<Event>                    m_events;
+    std::mutex                            m_mutex;
+};
+
+//
+// Record a trace event for the lifetime of the scope.
+//
+struct CProfileScope
+{
+    CProfileScope(const char* name) : m_name(name), m_start(CProfiler::Get().Now()) {}
+    ~CProfileScope()
+    {
+        CProfiler::Get().Record(m_name, m_start, CProfiler::Get().Now());
+    }
+
+    const char* m_name;
+    double      m_start;
+};
+
+#define PROFILE_CONCAT_(a, b)   a##b
+#define PROFILE_CONCAT(a, b)    PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name)     CProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNT(c, n)     CProfiler::Get().Count(c, static_cast<uint64_t>(n))
+#define PROFILE_PHASE(name, w)  CProfiler::Get().Record(name, CProfiler::Get().Since((w).m_start), CProfiler::Get().Now())
+#define PROFILE_BEGIN()         CProfiler::Get().Begin()
+#define PROFILE_REPORT(times)   CProfiler::Get().Report(times)
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(c, n)
+#define PROFILE_PHASE(name, w)
+#define PROFILE_BEGIN()
+#define PROFILE_REPORT(times)
+
+#endif
@@ -0,0 +1,557 @@
+//
+// Streaming decimation of a binary STL file larger than the memory. The triangles are bucketed
+// into spatial chunks by their centroids, and each chunk is read from the mapped file and
+// decimated with its borders constrained. The triangles touching the chunk borders are then
+// bucketed again into a grid shifted by half a chunk and decimated bucket by bucket in a seam
+// pass.
+//
+
+#pragma once
+
+#include "decimate.hpp"
+#include "logcache.hpp"
+
+#include <lxsdk/lx_log.hpp>
+#include <lxsdk/lxu_command.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define STREAMs_INPUT  "input"
+#define STREAMs_OUTPUT "output"
+#define STREAMs_RATIO  "ratio"
+#define STREAMs_COST   "costStrategy"
+#define STREAMs_CHUNK  "chunk"
+
+#define STREAMa_INPUT  0
+#define STREAMa_OUTPUT 1
+#define STREAMa_RATIO  2
+#define STREAMa_COST   3
+#define STREAMa_CHUNK  4
+
+//
+// Binary STL: 80 bytes header, triangle count and 50 bytes per triangle of the normal, three
+// vertices and the attribute.
+//
+struct CStlFile
+{
+    static const size_t HeaderSize = 84;
+    static const size_t RecordSize = 50;
+
+    CMappedFile file;
+    uint32_t    count = 0;
+
+    bool Open(const std::string& path)
+    {
+        if (!file.Open(path) || file.Size() < HeaderSize)
+            return false;
+        std::memcpy(&count, file.Data() + 80, sizeof(count));
+        return file.Size() >= HeaderSize + RecordSize * static_cast<size_t>(count);
+    }
+
+    // Get the three vertices of the triangle.
+    void Triangle(size_t i, float v[9]) const
+    {
+        std::memcpy(v, file.Data() + HeaderSize + RecordSize * i + 12, sizeof(float) * 9);
+    }
+
+    // Get the attribute of the triangle.
+    uint16_t Attribute(size_t i) const
+    {
+        uint16_t attr;
+        std::memcpy(&attr, file.Data() + HeaderSize + RecordSize * i + 48, sizeof(attr));
+        return attr;
+    }
+};
+
+class CStlWriter
+{
+public:
+    ~CStlWriter()
+    {
+        Close();
+    }
+
+    bool Open(const std::string& path)
+    {
+        m_fp = fopen(path.c_str(), "wb");
+        if (!m_fp)
+            return false;
+        char header[80] = "decimate";
+        m_count = 0;
+        return fwrite(header, 1, 80, m_fp) == 80 && fwrite(&m_count, sizeof(m_count), 1, m_fp) == 1;
+    }
+
+    bool Add(const float v[9], uint16_t attr = 0)
+    {
+        float    n[3];
+        float    e1[3] = { v[3] - v[0], v[4] - v[1], v[5] - v[2] };
+        float    e2[3] = { v[6] - v[0], v[7] - v[1], v[8] - v[2] };
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+        float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (auto k = 0; k < 3 && len > 0.0f; k++)
+            n[k] /= len;
+        m_count ++;
+        return fwrite(n, sizeof(float), 3, m_fp) == 3 && fwrite(v, sizeof(float), 9, m_fp) == 9 &&
+               fwrite(&attr, sizeof(attr), 1, m_fp) == 1;
+    }
+
+    // Write the triangle count into the header and close the file.
+    bool Close()
+    {
+        if (!m_fp)
+            return true;
+        bool ok = fseek(m_fp, 80, SEEK_SET) == 0 && fwrite(&m_count, sizeof(m_count), 1, m_fp) == 1;
+        if (fclose(m_fp) != 0)
+            ok = false;
+        m_fp = nullptr;
+        return ok;
+    }
+
+    uint32_t Count() const { return m_count; }
+
+private:
+    FILE*    m_fp    = nullptr;
+    uint32_t m_count = 0;
+};
+
+//
+// Indexed mesh welded from the triangles by their exact vertex positions. The raw flags of the
+// points are taken from the bits of the vertices in the triangle attributes.
+//
+struct CStreamChunk
+{
+    struct Key
+    {
+        float v[3];
+        bool operator==(const Key& k) const { return std::memcmp(v, k.v, sizeof(v)) == 0; }
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key& k) const
+        {
+            uint32_t h[3];
+            std::memcpy(h, k.v, sizeof(h));
+            return (static_cast<size_t>(h[0]) * 73856093u) ^ (static_cast<size_t>(h[1]) * 19349663u) ^
+                   (static_cast<size_t>(h[2]) * 83492791u);
+        }
+    };
+
+    std::vector<double>   points;
+    std::vector<uint32_t> tris;
+    std::vector<char>     border;
+    std::vector<char>     raw;
+    std::unordered_map<Key, uint32_t, KeyHash> welded;
+
+    void Clear()
+    {
+        points.clear();
+        tris.clear();
+        border.clear();
+        raw.clear();
+        welded.clear();
+    }
+
+    void Add(const float v[9], uint16_t attr = 0)
+    {
+        for (auto k = 0; k < 3; k++)
+        {
+            Key key;
+            std::memcpy(key.v, &v[k * 3], sizeof(key.v));
+            auto it = welded.emplace(key, static_cast<uint32_t>(points.size() / 3));
+            if (it.second)
+            {
+                points.insert(points.end(), { double(key.v[0]), double(key.v[1]), double(key.v[2]) });
+                raw.push_back(0);
+            }
+            tris.push_back(it.first->second);
+            if (attr & (1u << k))
+                raw[it.first->second] = 1;
+        }
+    }
+
+    void Get(size_t i, float v[9]) const
+    {
+        for (auto k = 0; k < 3; k++)
+        {
+            const double* p = &points[tris[i * 3 + k] * 3];
+            v[k * 3]     = static_cast<float>(p[0]);
+            v[k * 3 + 1] = static_cast<float>(p[1]);
+            v[k * 3 + 2] = static_cast<float>(p[2]);
+        }
+    }
+
+    bool OnBorder(size_t i) const
+    {
+        return border[tris[i * 3]] || border[tris[i * 3 + 1]] || border[tris[i * 3 + 2]];
+    }
+
+    // Bits of the vertices of the triangle on the borders.
+    uint16_t BorderBits(size_t i) const
+    {
+        return static_cast<uint16_t>(border[tris[i * 3]] | (border[tris[i * 3 + 1]] << 1) | (border[tris[i * 3 + 2]] << 2));
+    }
+};
+
+//
+// Streaming decimation driver. The memory holds one chunk at a time, and one bucket of the seam
+// strips in the seam pass.
+//
+struct CStreamDecimate
+{
+    size_t   m_chunkTriangles = 1000000;   // triangles per chunk on average
+
+    // Statistics of the last run.
+    unsigned m_chunks      = 0;     // non-empty chunks
+    size_t   m_maxChunk    = 0;     // triangles of the largest chunk
+    size_t   m_seam        = 0;     // triangles in the seam pass
+    unsigned m_seamChunks  = 0;     // non-empty buckets of the seam pass
+    size_t   m_maxSeam     = 0;     // triangles of the largest seam bucket
+    size_t   m_triangles   = 0;     // input triangles
+    size_t   m_output      = 0;     // output triangles
+
+    LxResult Run(CDecimate& dec, const std::string& input, const std::string& output)
+    {
+        CStlFile stl;
+        if (!stl.Open(input))
+            return LXe_NOTFOUND;
+        m_triangles = stl.count;
+        m_chunks = m_seamChunks = 0;
+        m_maxChunk = m_seam = m_maxSeam = m_output = 0;
+        if (stl.count == 0)
+            return LXe_FAILED;
+
+        // Bounding box of the centroids and the surface area.
+        float  lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 }, v[9];
+        double area = 0.0;
+        for (auto i = 0u; i < stl.count; i++)
+        {
+            stl.Triangle(i, v);
+            for (auto k = 0; k < 3; k++)
+            {
+                float c = (v[k] + v[k + 3] + v[k + 6]) / 3.0f;
+                lo[k] = (i == 0) ? c : std::min(lo[k], c);
+                hi[k] = (i == 0) ? c : std::max(hi[k], c);
+            }
+            double e1[3], e2[3];
+            for (auto k = 0; k < 3; k++)
+            {
+                e1[k] = double(v[k + 3]) - v[k];
+                e2[k] = double(v[k + 6]) - v[k];
+            }
+            double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            area += 0.5 * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        }
+
+        // Grid of cubic cells of about the chunk count. A surface fills a shell of the volume,
+        // so a cell covers about its square of the surface. The cell count is capped, and flat
+        // extents get one cell.
+        static const double MaxCells = double(1u << 20);
+        double nchunks = std::ceil(double(stl.count) / std::max<size_t>(m_chunkTriangles, 1));
+        double span    = std::max({ hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2] });
+        double extent[3], volume = 1.0;
+        for (auto k = 0; k < 3; k++)
+        {
+            extent[k] = std::max<double>(hi[k] - lo[k], span * 1e-3);
+            volume   *= extent[k];
+        }
+        double cell = (area > 0.0) ? std::sqrt(area / nchunks) : std::cbrt(volume / nchunks);
+        cell = std::max(cell, std::cbrt(volume / MaxCells));
+        unsigned grid[3];
+        for (auto k = 0; k < 3; k++)
+            grid[k] = std::max(1u, static_cast<unsigned>(std::ceil(extent[k] / cell)));
+        size_t ncells = size_t(grid[0]) * grid[1] * grid[2];
+
+        auto cell_of = [&](const float t[9]) {
+            size_t index = 0;
+            for (int k = 2; k >= 0; k--)
+            {
+                float    c = (t[k] + t[k + 3] + t[k + 6]) / 3.0f;
+                unsigned g = static_cast<unsigned>((c - lo[k]) / cell);
+                index = index * grid[k] + std::min(g, grid[k] - 1);
+            }
+            return index;
+        };
+
+        // Bucket the triangle indices by the cells into the chunk file.
+        std::vector<uint64_t> offset(ncells + 1, 0);
+        for (auto i = 0u; i < stl.count; i++)
+        {
+            stl.Triangle(i, v);
+            offset[cell_of(v) + 1] ++;
+        }
+        for (auto c = 0u; c < ncells; c++)
+            offset[c + 1] += offset[c];
+
+        std::string chunk_path = output + ".chunks.tmp";
+        std::string seam_path  = output + ".seams.tmp";
+        if (!WriteBuckets(stl, chunk_path, offset, cell_of))
+            return Finish(LXe_FAILED, chunk_path, seam_path);
+
+        CMappedFile buckets;
+        if (!buckets.Open(chunk_path))
+            return Finish(LXe_FAILED, chunk_path, seam_path);
+        auto indices = reinterpret_cast<const uint32_t*>(buckets.Data());
+
+        CStlWriter out, seams;
+        if (!out.Open(output) || !seams.Open(seam_path))
+            return Finish(LXe_FAILED, chunk_path, seam_path);
+
+        // Decimate each chunk, and put aside the triangles on its borders for the seam pass with
+        // the bits of their vertices on the borders, whose edges are not reduced yet.
+        CStreamChunk chunk;
+        for (auto c = 0u; c < ncells; c++)
+        {
+            if (offset[c] == offset[c + 1])
+                continue;
+            chunk.Clear();
+            for (auto j = offset[c]; j < offset[c + 1]; j++)
+            {
+                stl.Triangle(indices[j], v);
+                chunk.Add(v);
+            }
+            m_chunks ++;
+            m_maxChunk = std::max<size_t>(m_maxChunk, offset[c + 1] - offset[c]);
+            chunk.welded.clear();
+
+            if (dec.DecimateIndexed(chunk.points, chunk.tris, chunk.border) != LXe_OK ||
+                dec.Cancelled("stream", double(c + 1) / ncells))
+                return Finish(LXe_ABORT, chunk_path, seam_path);
+
+            for (auto i = 0u; i < chunk.tris.size() / 3; i++)
+            {
+                chunk.Get(i, v);
+                if (!(chunk.OnBorder(i) ? seams.Add(v, chunk.BorderBits(i)) : out.Add(v)))
+                    return Finish(LXe_FAILED, chunk_path, seam_path);
+            }
+        }
+        buckets.Close();
+        if (!seams.Close())
+            return Finish(LXe_FAILED, chunk_path, seam_path);
+
+        // Bucket the seam strips into the grid shifted by half a cell, whose cells hold the chunk
+        // borders in their middles, and decimate the buckets one by one. The open borders of a
+        // bucket face the written triangles or the other buckets and stay.
+        CStlFile strip;
+        if (!strip.Open(seam_path))
+            return Finish(LXe_FAILED, chunk_path, seam_path);
+        m_seam = strip.count;
+
+        unsigned shifted[3];
+        for (auto k = 0; k < 3; k++)
+            shifted[k] = grid[k] + 1;
+        size_t nshifted = size_t(shifted[0]) * shifted[1] * shifted[2];
+
+        auto shifted_of = [&](const float t[9]) {
+            size_t index = 0;
+            for (int k = 2; k >= 0; k--)
+            {
+                float    c = (t[k] + t[k + 3] + t[k + 6]) / 3.0f;
+                unsigned g = static_cast<unsigned>((c - lo[k]) / cell + 0.5);
+                index = index * shifted[k] + std::min(g, shifted[k] - 1);
+            }
+            return index;
+        };
+
+        std::vector<uint64_t> seam_offset(nshifted + 1, 0);
+        for (auto i = 0u; i < strip.count; i++)
+        {
+            strip.Triangle(i, v);
+            seam_offset[shifted_of(v) + 1] ++;
+        }
+        for (auto c = 0u; c < nshifted; c++)
+            seam_offset[c + 1] += seam_offset[c];
+        if (!WriteBuckets(strip, chunk_path, seam_offset, shifted_of) || !buckets.Open(chunk_path))
+            return Finish(LXe_FAILED, chunk_path, seam_path);
+        indices = reinterpret_cast<const uint32_t*>(buckets.Data());
+
+        for (auto c = 0u; c < nshifted; c++)
+        {
+            if (seam_offset[c] == seam_offset[c + 1])
+                continue;
+            chunk.Clear();
+            for (auto j = seam_offset[c]; j < seam_offset[c + 1]; j++)
+            {
+                strip.Triangle(indices[j], v);
+                chunk.Add(v, strip.Attribute(indices[j]));
+            }
+            m_seamChunks ++;
+            m_maxSeam = std::max<size_t>(m_maxSeam, seam_offset[c + 1] - seam_offset[c]);
+            chunk.welded.clear();
+
+            if (dec.DecimateIndexed(chunk.points, chunk.tris, chunk.border, &chunk.raw) != LXe_OK ||
+                dec.Cancelled("seam", double(c + 1) / nshifted))
+                return Finish(LXe_ABORT, chunk_path, seam_path);
+
+            for (auto i = 0u; i < chunk.tris.size() / 3; i++)
+            {
+                chunk.Get(i, v);
+                if (!out.Add(v))
+                    return Finish(LXe_FAILED, chunk_path, seam_path);
+            }
+        }
+        buckets.Close();
+        strip.file.Close();
+        m_output = out.Count();
+        if (!out.Close())
+            return Finish(LXe_FAILED, chunk_path, seam_path);
+        return Finish(LXe_OK, chunk_path, seam_path);
+    }
+
+    void Report() const
+    {
+        CLxUser_LogService s_log;
+        CLxUser_Log        log;
+        if (!s_log.GetSubSystem(LXsLOG_LOGSYS, log))
+            return;
+
+        char buf[256];
+        snprintf(buf, sizeof(buf), "Decimate stream: %zu triangles in %u chunks (largest %zu), seam pass %zu in %u buckets (largest %zu), output %zu",
+                 m_triangles, m_chunks, m_maxChunk, m_seam, m_seamChunks, m_maxSeam, m_output);
+        log.Message(LXe_INFO, buf);
+    }
+
+private:
+    // Seek to the 64-bit offset in the file.
+    static bool Seek(FILE* fp, uint64_t offset)
+    {
+#if defined(_WIN32)
+        return _fseeki64(fp, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+        return fseeko(fp, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+    }
+
+    //
+    // Write the triangle indices sorted by the cells. Each cell is buffered and written at its
+    // own offset when the buffer is full.
+    //
+    template <typename F>
+    static bool WriteBuckets(const CStlFile& stl, const std::string& path, const std::vector<uint64_t>& offset, F cell_of)
+    {
+        static const size_t Buffer = 4096;
+
+        FILE* fp = fopen(path.c_str(), "wb");
+        if (!fp)
+            return false;
+        size_t ncells = offset.size() - 1;
+        std::vector<std::vector<uint32_t>> buffers(ncells);
+        std::vector<uint64_t>              written(offset.begin(), offset.end() - 1);
+        auto flush = [&](size_t c) {
+            auto& buffer = buffers[c];
+            if (buffer.empty())
+                return true;
+            bool ok = Seek(fp, written[c] * sizeof(uint32_t)) &&
+                      fwrite(buffer.data(), sizeof(uint32_t), buffer.size(), fp) == buffer.size();
+            written[c] += buffer.size();
+            buffer.clear();
+            return ok;
+        };
+
+        bool  ok = true;
+        float v[9];
+        for (auto i = 0u; ok && i < stl.count; i++)
+        {
+            stl.Triangle(i, v);
+            size_t c = cell_of(v);
+            buffers[c].push_back(i);
+            if (buffers[c].size() >= Buffer)
+                ok = flush(c);
+        }
+        for (auto c = 0u; ok && c < ncells; c++)
+            ok = flush(c);
+        if (fclose(fp) != 0)
+            ok = false;
+        return ok;
+    }
+
+    // Remove the temporary files and return the result.
+    static LxResult Finish(LxResult result, const std::string& chunk_path, const std::string& seam_path)
+    {
+        std::remove(chunk_path.c_str());
+        std::remove(seam_path.c_str());
+        return result;
+    }
+};
+
+//
+// Headless command to decimate a binary STL file by streaming chunks.
+//
+class CStream : public CLxBasicCommand
+{
+public:
+    CStream()
+    {
+        static const LXtTextValueHint decimate_cost[] = {
+            { CDecimate::Edge_Length, "Edge_Length" },
+            { CDecimate::Lindstrom_Turk, "Lindstrom_Turk" },
+            { CDecimate::Garland_Heckbert, "Garland_Heckbert" },
+            { 0, "=decimate_cost" }, 0
+        };
+
+        dyna_Add(STREAMs_INPUT, LXsTYPE_FILEPATH);
+        dyna_Add(STREAMs_OUTPUT, LXsTYPE_FILEPATH);
+        dyna_Add(STREAMs_RATIO, LXsTYPE_PERCENT);
+        dyna_Add(STREAMs_COST, LXsTYPE_INTEGER);
+        dyna_SetHint(STREAMa_COST, decimate_cost);
+        dyna_Add(STREAMs_CHUNK, LXsTYPE_INTEGER);
+
+        basic_SetFlags(STREAMa_RATIO, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(STREAMa_COST, LXfCMDARG_OPTIONAL);
+        basic_SetFlags(STREAMa_CHUNK, LXfCMDARG_OPTIONAL);
+    }
+
+    static void initialize()
+    {
+        CLxGenericPolymorph* srv;
+
+        srv = new CLxPolymorph<CStream>;
+        srv->AddInterface(new CLxIfc_Command<CStream>);
+        srv->AddInterface(new CLxIfc_Attributes<CStream>);
+        srv->AddInterface(new CLxIfc_AttributesUI<CStream>);
+        lx::AddServer("decimate.stream", srv);
+    }
+
+    int basic_CmdFlags()
+    {
+        return 0;
+    }
+
+    void basic_Execute(unsigned int flags)
+    {
+        std::string     input, output;
+        CDecimate       dec;
+        CStreamDecimate stream;
+        int             chunk = 0;
+
+        dyna_String(STREAMa_INPUT, input);
+        dyna_String(STREAMa_OUTPUT, output);
+        dec.m_mode  = CDecimate::Ratio;
+        dec.m_ratio = 0.1;
+        dec.m_cost  = CDecimate::Lindstrom_Turk;
+        if (dyna_IsSet(STREAMa_RATIO))
+            attr_GetFlt(STREAMa_RATIO, &dec.m_ratio);
+        if (dyna_IsSet(STREAMa_COST))
+            attr_GetInt(STREAMa_COST, &dec.m_cost);
+        if (dyna_IsSet(STREAMa_CHUNK))
+            attr_GetInt(STREAMa_CHUNK, &chunk);
+        if (chunk > 0)
+            stream.m_chunkTriangles = static_cast<size_t>(chunk);
+
+        LxResult result = stream.Run(dec, input, output);
+        if (result != LXe_OK)
+        {
+            basic_Message().SetCode(result);
+            return;
+        }
+        stream.Report();
+    }
+};
@@ -4,6 +4,9 @@
 
 #include "tool.hpp"
 #include "command.hpp"
+#include "bench.hpp"
+#include "cache.hpp"
+#include "stream.hpp"
 
 /*
  * On create we add our one tool attribute. We also allocate a vector type
@@ -40,6 +43,18 @@ CTool::CTool()
 
     dyna_Add(ATTRs_PREMAT, LXsTYPE_BOOLEAN);
 
+    dyna_Add(ATTRs_TOPO, LXsTYPE_BOOLEAN);
+
+    dyna_Add(ATTRs_INCR, LXsTYPE_BOOLEAN);
+
+    dyna_Add(ATTRs_PREVIEW, LXsTYPE_BOOLEAN);
+
+    dyna_Add(ATTRs_BUDGET, LXsTYPE_TIME);
+
+    dyna_Add(ATTRs_CLUSTER, LXsTYPE_BOOLEAN);
+
+    dyna_Add(ATTRs_TILES, LXsTYPE_INTEGER);
+
     tool_Reset();
 
     sPkt.NewVectorType(LXsCATEGORY_TOOL, v_type);
@@ -76,6 +91,12 @@ void CTool::tool_Reset()
     dyna_Value(ATTRa_COST).SetInt(CDecimate::Lindstrom_Turk);
     dyna_Value(ATTRa_PREBND).SetInt(0);
     dyna_Value(ATTRa_PREMAT).SetInt(0);
+    dyna_Value(ATTRa_TOPO).SetInt(0);
+    dyna_Value(ATTRa_INCR).SetInt(0);
+    dyna_Value(ATTRa_PREVIEW).SetInt(0);
+    dyna_Value(ATTRa_BUDGET).SetFlt(0.0);
+    dyna_Value(ATTRa_CLUSTER).SetInt(0);
+    dyna_Value(ATTRa_TILES).SetInt(0);
 }
 
 /*
@@ -112,6 +133,12 @@ LxResult CTool::tool_GetOp(void** ppvObj, unsigned flags)
     dyna_Value(ATTRa_COST).GetInt(&toolop->m_cost);
     dyna_Value(ATTRa_PREBND).GetInt(&toolop->m_preserveBoundary);
     dyna_Value(ATTRa_PREMAT).GetInt(&toolop->m_preserveMaterial);
+    dyna_Value(ATTRa_TOPO).GetInt(&toolop->m_topologyConstant);
+    dyna_Value(ATTRa_INCR).GetInt(&toolop->m_incremental);
+    dyna_Value(ATTRa_PREVIEW).GetInt(&toolop->m_preview);
+    dyna_Value(ATTRa_BUDGET).GetFlt(&toolop->m_timeBudget);
+    dyna_Value(ATTRa_CLUSTER).GetInt(&toolop->m_cluster);
+    dyna_Value(ATTRa_TILES).GetInt(&toolop->m_tiles);
 
     toolop->offset_view = offset_view;
     toolop->offset_screen = offset_screen;
@@ -181,6 +208,9 @@ LxResult CTool::tmod_Down(ILxUnknownID vts, ILxUnknownID adjust)
     dyna_Value(ATTRa_RATIO).GetFlt(&m_ratio0);
     dyna_Value(ATTRa_COUNT).GetInt(&m_count0);
 
+    // Evaluate the fast preview while hauling.
+    at.SetInt(ATTRa_PREVIEW, 1);
+
     return LXe_TRUE;
 }
 
@@ -215,8 +245,13 @@ void CTool::tmod_Move(ILxUnknownID vts, ILxUnknownID adjust)
 
 void CTool::tmod_Up(ILxUnknownID vts, ILxUnknownID adjust)
 {
+    CLxUser_AdjustTool at(adjust);
+
     m_count0 = 0;
     m_ratio0 = 0.0;
+
+    // Evaluate the selected cost strategy once on release.
+    at.SetInt(ATTRa_PREVIEW, 0);
 }
 
 void CTool::atrui_UIHints2(unsigned int index, CLxUser_UIHints& hints)
@@ -231,6 +266,14 @@ void CTool::atrui_UIHints2(unsigned int index, CLxUser_UIHints& hints)
         case ATTRa_COUNT:
             hints.MinInt(0);
             break;
+
+        case ATTRa_BUDGET:
+            hints.MinFloat(0.0);
+            break;
+
+        case ATTRa_TILES:
+            hints.MinInt(0);
+            break;
     }
 }
 
@@ -353,6 +396,49 @@ LxResult CTool::cui_DependencyByIndex (const char *channelName, unsigned index,
 	return LXe_OUTOFBOUNDS;
 }
 
+/*
+ * Monitor of the decimation of a large layer. The collapse runs on a worker thread and
+ * the monitor steps with the progress of each phase. Aborting the monitor cancels the
+ * decimation and leaves the mesh as it is.
+ */
+class CDecimateMonitor
+{
+public:
+    static const unsigned MinPolygons = 200000;
+
+    CDecimateMonitor(CDecimate& dec, CLxUser_Mesh& base_mesh) : m_dec(dec)
+    {
+        unsigned npol = 0;
+        base_mesh.PolygonCount(&npol);
+        if (npol < MinPolygons || !m_dlg.MonitorAllocate("Decimate", m_monitor))
+            return;
+        m_monitor.Init(100);
+        m_dec.m_background = 1;
+        m_dec.m_progress   = [this](const char* phase, double fraction) {
+            unsigned step  = static_cast<unsigned>(PhaseProgress(phase, fraction) * 100.0);
+            unsigned delta = (step > m_stepped) ? step - m_stepped : 0;
+            m_stepped += delta;
+            return m_monitor.Step(delta);  // a zero step still checks the abort
+        };
+    }
+
+    ~CDecimateMonitor()
+    {
+        if (!m_monitor.test())
+            return;
+        m_dec.m_background = 0;
+        m_dec.m_progress   = nullptr;
+        m_monitor.clear();
+        m_dlg.MonitorRelease();
+    }
+
+private:
+    CDecimate&               m_dec;
+    CLxUser_StdDialogService m_dlg;
+    CLxUser_Monitor          m_monitor;
+    unsigned                 m_stepped = 0;
+};
+
 /*
  * Tool evaluation uses layer scan interface to walk through all the active
  * meshes and visit all the selected polygons.
@@ -391,6 +477,9 @@ LxResult CToolOp::top_Evaluate(ILxUnknownID vts)
     dec.m_cost = m_cost;
     dec.m_preserveBoundary = m_preserveBoundary;
     dec.m_preserveMaterial = m_preserveMaterial;
+    dec.m_timeBudget = m_timeBudget;
+    dec.m_cluster = m_cluster;
+    dec.m_tiles = m_tiles;
 
     auto n = scan.NumLayers();
     for (auto i = 0u; i < n; i++)
@@ -398,8 +487,100 @@ LxResult CToolOp::top_Evaluate(ILxUnknownID vts)
         scan.BaseMeshByIndex(i, base_mesh);
         scan.EditMeshByIndex(i, edit_mesh);
 
-        dec.DecimateMesh(base_mesh);
+        // A newer evaluation of the same layer cancels this one, and the cancelled
+        // decimation leaves the mesh as it is.
+        CLxUser_Item item;
+        const char*  ident = nullptr;
+        std::string  owner;
+        if (scan.ItemByIndex(i, item) && LXx_OK(item.Ident(&ident)) && ident)
+            owner = ident;
+        CDecimateJob job(owner);
+        dec.m_cancel = job.Token();
+        dec.m_expired = 0;
+
+        // While hauling, the preview replays the Edge-Length collapse sequence of the mesh.
+        // The mesh is left as it is until the sequence is recorded.
+        if (m_preview)
+        {
+            if (dec.DecimatePreview(base_mesh) != LXe_OK)
+                continue;
+            dec.m_cmesh.ApplyMesh(edit_mesh, dec.m_triple);
+            scan.SetMeshChange(i, LXf_MESHEDIT_GEOMETRY);
+            continue;
+        }
+
+        // The result of the same mesh content with the same parameters is replayed from
+        // the cache without the decimation.
+        CContentHash params;
+        params.Add(m_mode);
+        params.Add(m_mode == CDecimate::Ratio ? m_ratio : 0.0);
+        params.Add(m_mode == CDecimate::Count ? m_count : 0);
+        params.Add(m_cost);
+        params.Add(m_preserveBoundary);
+        params.Add(m_preserveMaterial);
+        params.Add(m_topologyConstant);
+        params.Add(m_incremental);
+        params.Add(m_timeBudget);
+        params.Add(m_cluster);
+        params.Add(m_tiles);
+        params.Add(dec.m_triple);
+
+        CContentHash key;
+        key.Add(MeshContentHash(base_mesh));
+        key.Add(params.value);
+
+        auto& cache = CResultCache::Instance();
+        if (auto result = cache.Find(key.value))
+        {
+            if (dec.m_cmesh.ApplyResult(edit_mesh, *result) == LXe_OK)
+            {
+                scan.SetMeshChange(i, LXf_MESHEDIT_GEOMETRY);
+                continue;
+            }
+        }
+
+        CDecimateMonitor monitor(dec, base_mesh);
+
+        // In incremental mode, only the parts changed since the last evaluations are decimated.
+        if (m_incremental && !m_topologyConstant && m_mode == CDecimate::Ratio)
+        {
+            if (dec.DecimateIncremental(base_mesh, params.value) != LXe_OK)
+                continue;
+            dec.m_cmesh.ApplyResult(edit_mesh, dec.m_cmesh.m_result);
+            if (!dec.m_expired)
+                cache.Insert(key.value, std::make_shared<CDecimateResult>(dec.m_cmesh.m_result));
+            scan.SetMeshChange(i, LXf_MESHEDIT_GEOMETRY);
+            continue;
+        }
+
+        // In topology constant mode, the collapse sequence of the first frame is replayed for
+        // the other frames of the same topology with the placements from their positions.
+        CContentHash topology;
+        bool         replayed = false;
+        if (m_topologyConstant)
+        {
+            topology.Add(MeshContentHash(base_mesh, false));
+            topology.Add(params.value);
+            if (auto sequence = CSequenceCache::Instance().Find(topology.value))
+                replayed = dec.DecimateBySequence(base_mesh, *sequence) == LXe_OK;
+        }
+        if (!replayed)
+        {
+            dec.m_sequence = m_topologyConstant;
+            if (dec.DecimateMesh(base_mesh) != LXe_OK)
+                continue;
+            if (m_topologyConstant && !dec.m_expired)
+            {
+                auto sequence = std::make_shared<CAnimationSequence>();
+                if (dec.MakeSequence(*sequence) == LXe_OK)
+                    CSequenceCache::Instance().Insert(topology.value, sequence);
+            }
+        }
+        // A result cut short by the time budget is not kept, so the next evaluation may get further.
         dec.m_cmesh.ApplyMesh(edit_mesh, dec.m_triple);
+        if (!dec.m_expired)
+            cache.Insert(key.value, std::make_shared<CDecimateResult>(dec.m_cmesh.m_result));
+        PROFILE_REPORT(dec.m_cmesh.m_times);
 
         scan.SetMeshChange(i, LXf_MESHEDIT_GEOMETRY);
     }
@@ -430,4 +611,6 @@ void initialize()
     lx::AddSpawner(SRVNAME_TOOLOP, srv);
 
     CCommand::initialize();
+    CBench::initialize();
+    CStream::initialize();
 }
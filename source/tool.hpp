@@ -40,6 +40,12 @@ using namespace lx_err;
 #define ATTRs_COST   "costStrategy"
 #define ATTRs_PREBND "preserveBoundary"
 #define ATTRs_PREMAT "preserveMaterial"
+#define ATTRs_TOPO   "topologyConstant"
+#define ATTRs_INCR   "incremental"
+#define ATTRs_PREVIEW "preview"
+#define ATTRs_BUDGET "timeBudget"
+#define ATTRs_CLUSTER "cluster"
+#define ATTRs_TILES  "tiles"
 
 #define ATTRa_MODE     0
 #define ATTRa_RATIO    1
@@ -47,6 +53,12 @@ using namespace lx_err;
 #define ATTRa_COST     3
 #define ATTRa_PREBND   4
 #define ATTRa_PREMAT   5
+#define ATTRa_TOPO     6
+#define ATTRa_INCR     7
+#define ATTRa_PREVIEW  8
+#define ATTRa_BUDGET   9
+#define ATTRa_CLUSTER  10
+#define ATTRa_TILES    11
 
 #ifndef LXx_OVERRIDE
 #define LXx_OVERRIDE override
@@ -76,6 +88,12 @@ class CToolOp : public CLxImpl_ToolOperation
         int    m_cost;
         int    m_preserveBoundary;
         int    m_preserveMaterial;
+        int    m_topologyConstant;
+        int    m_incremental;
+        int    m_preview;   // evaluate the fast preview while hauling
+        double m_timeBudget;
+        int    m_cluster;
+        int    m_tiles;
     
         CLxUser_Edge m_cedge;
 };
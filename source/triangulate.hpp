@@ -20,9 +20,13 @@
 
 #include <CGAL/mark_domain_in_triangulation.h>
 
+#include <algorithm>
+#include <cmath>
+#include <memory>
 #include <vector>
 
 #include "util.hpp"
+#include "profile.hpp"
 
 typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
 typedef CGAL::Triangulation_vertex_base_2<K> Vb;
@@ -36,95 +40,201 @@ typedef CDT::Vertex_handle Vertex_handle;
 typedef CDT::Face_handle Face_handle;
 typedef CDT::Point CPoint;
 
-class CTriangulate
+//
+// Number of source polygons by the triangulation method used in BuildMesh.
+//
+struct CTriangulateStats
 {
-public:
-    CTriangulate (CLxUser_Mesh& mesh) { m_mesh = mesh; }
-    LxResult ConstraintDelaunay(AxisPlane& axisPlane, std::vector<LXtPointID>& source, std::vector<std::vector<LXtPointID>>& tris)
+    unsigned simple   = 0;  // triangles and quads
+    unsigned convex   = 0;  // convex n-gons triangulated by fan
+    unsigned cdt      = 0;  // n-gons triangulated by constrained Delaunay
+    unsigned fallback = 0;  // n-gons failed in constrained Delaunay and triangulated by ear clipping
+    unsigned failed   = 0;  // n-gons failed in both and triangulated by simple fan
+    unsigned generated = 0; // polygons triangulated by GenerateTriangles
+
+    void Clear()
     {
-        CLxUser_Point point, point1;
-        point.fromMesh(m_mesh);
-        point1.fromMesh(m_mesh);
+        *this = CTriangulateStats();
+    }
+};
 
-        CDT cdt;
+//
+// Uniform grid of polygon vertices on the axis plane to find the vertices in a triangle
+// without visiting all vertices.
+//
+struct CVertexGrid
+{
+    CVertexGrid(const CPolygon2D& poly)
+    {
+        auto n = poly.Size();
+        double w = std::max(poly.x_max - poly.x_min, 1e-30);
+        double h = std::max(poly.y_max - poly.y_min, 1e-30);
+        double cell = std::sqrt(w * h / n);
+        if (cell <= 0.0)
+            cell = std::max(w, h) / std::sqrt(static_cast<double>(n));
+        m_x0 = poly.x_min;
+        m_y0 = poly.y_min;
+        m_nx = static_cast<unsigned>(std::min(w / cell, static_cast<double>(n))) + 1;
+        m_ny = static_cast<unsigned>(std::min(h / cell, static_cast<double>(n))) + 1;
+        m_sx = m_nx / w;
+        m_sy = m_ny / h;
+
+        // Bucket the vertices by cell in the compressed row layout.
+        m_start.assign(m_nx * m_ny + 1, 0);
+        for (auto i = 0u; i < n; i++)
+            m_start[Cell(poly.X(i), poly.Y(i)) + 1] ++;
+        for (auto i = 0u; i < m_nx * m_ny; i++)
+            m_start[i + 1] += m_start[i];
+        m_items.resize(n);
+        std::vector<unsigned> fill(m_start.begin(), m_start.end() - 1);
+        for (auto i = 0u; i < n; i++)
+            m_items[fill[Cell(poly.X(i), poly.Y(i))] ++] = i;
+    }
 
-        std::vector<Vertex_handle> vertex_handles;
+    unsigned Column(double x) const { return static_cast<unsigned>(std::min(m_nx - 1.0, std::max(0.0, (x - m_x0) * m_sx))); }
+    unsigned Row(double y) const { return static_cast<unsigned>(std::min(m_ny - 1.0, std::max(0.0, (y - m_y0) * m_sy))); }
+    unsigned Cell(double x, double y) const { return Row(y) * m_nx + Column(x); }
+
+    //
+    // Call func with each vertex index in the cells overlapping the given bounding box. This
+    // stops when func returns false, and returns false then.
+    //
+    template <typename F>
+    bool Query(double x0, double y0, double x1, double y1, F func) const
+    {
+        auto c0 = Column(x0), c1 = Column(x1);
+        auto r0 = Row(y0), r1 = Row(y1);
+        for (auto r = r0; r <= r1; r++)
+        {
+            for (auto c = c0; c <= c1; c++)
+            {
+                auto cell = r * m_nx + c;
+                for (auto k = m_start[cell]; k < m_start[cell + 1]; k++)
+                {
+                    if (!func(m_items[k]))
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
 
-        std::unordered_map<LXtPointID,unsigned> indices;
+    double   m_x0, m_y0, m_sx, m_sy;
+    unsigned m_nx, m_ny;
+    std::vector<unsigned> m_start;  // first item of each cell
+    std::vector<unsigned> m_items;  // vertex indices bucketed by cell
+};
 
-        CLxUser_MeshService s_mesh;
+class CTriangulate
+{
+public:
+    // Maximum distance from the axis plane relative to the extent of the polygon on the plane
+    // to be triangulated by ConvexFan.
+    static constexpr double PlanarTolerance = 1e-3;
 
-        LXtMarkMode mark_dupl;
-        mark_dupl = s_mesh.ClearMode(LXsMARK_USER_0);
+    CTriangulate (CLxUser_Mesh& mesh) { m_mesh = mesh; }
 
+    //
+    // Triangulate the polygon by a fan from the first vertex when the polygon is strictly convex
+    // and nearly planar on the axis plane. This returns false without triangles for concave,
+    // self-overlapping, keyholed or non-planar polygons, which need ConstraintDelaunay.
+    //
+    bool ConvexFan(AxisPlane& axisPlane, std::vector<LXtPointID>& source, std::vector<std::vector<LXtPointID>>& tris)
+    {
         auto nvert = source.size();
+        if (nvert < 3)
+            return false;
+
+        // Keyhole polygons visit the bridge vertices twice.
+        std::vector<LXtPointID> sorted(source);
+        std::sort(sorted.begin(), sorted.end());
+        if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+            return false;
+
+        CPolygon2D poly(m_mesh, axisPlane, source);
+        double extent = poly.Extent();
+        if (extent <= 0.0)
+            return false;
+        if (poly.z_max - poly.z_min > extent * PlanarTolerance)
+            return false;
+
+        // All turns must have the same direction and the boundary must wind only once.
+        // Collinear vertices are left to ConstraintDelaunay to avoid degenerated fan triangles.
+        double eps   = extent * extent * 1e-12;
+        int    sign  = 0;
+        double angle = 0.0;
         for (auto i = 0u; i < nvert; i++)
         {
-            point.Select(source[i]);
-            point.SetMarks(mark_dupl);
+            auto   j   = (i + 1) % nvert;
+            auto   k   = (i + 2) % nvert;
+            double ax  = poly.X(j) - poly.X(i);
+            double ay  = poly.Y(j) - poly.Y(i);
+            double bx  = poly.X(k) - poly.X(j);
+            double by  = poly.Y(k) - poly.Y(j);
+            double crs = ax * by - ay * bx;
+            if (std::abs(crs) <= eps)
+                return false;
+            int s = (crs > 0.0) ? 1 : -1;
+            if (sign == 0)
+                sign = s;
+            else if (s != sign)
+                return false;
+            angle += std::atan2(crs, ax * bx + ay * by);
         }
+        if (std::abs(angle) > 3.0 * 3.14159265358979323846)
+            return false;
 
-        mark_dupl = s_mesh.SetMode(LXsMARK_USER_0);
-
-        unsigned n = 0;
-        for (auto i = 0u; i < nvert; i++)
+        tris.clear();
+        for (auto i = 1u; i + 1 < nvert; i++)
         {
-            LXtPointID vrt = source[i];
-            if (indices.find(vrt) == indices.end())
-            {
-                indices.insert(std::make_pair(vrt, n ++));
-            }
-            else
-            {
-                point.Select(vrt);
-                point.SetMarks(mark_dupl);
-            }
+            tris.push_back({ source[0], source[i], source[i + 1] });
         }
+        return true;
+    }
+    LxResult ConstraintDelaunay(AxisPlane& axisPlane, std::vector<LXtPointID>& source, std::vector<std::vector<LXtPointID>>& tris)
+    {
+        CPolygon2D poly(m_mesh, axisPlane, source);
+
+        CDT cdt;
+
+        auto nvert = source.size();
+
+        // Vertex handle of each source vertex and the source point of each vertex handle.
+        // Keyhole polygons have the same point twice and CDT merges them into one handle.
+        std::vector<Vertex_handle> vertex_handles;
+        std::unordered_map<Vertex_handle,LXtPointID> handle_points;
+        vertex_handles.reserve(nvert);
 
-        double   z_ave = 0.0;
         for (auto i = 0u; i < nvert; i++)
         {
-            point.Select(source[i]);
-            LXtFVector pos;
-            point.Pos(pos);
-            double x, y, z;
-            axisPlane.ToPlane(pos, x, y, z);
             try
             {
-                vertex_handles.push_back(cdt.insert(CPoint(x, y)));
+                vertex_handles.push_back(cdt.insert(CPoint(poly.X(i), poly.Y(i))));
+                handle_points[vertex_handles.back()] = source[i];
             }
             catch(...)
             {
-                printf("CGAL Error pos %f %f %f x %f y %f line (%d)\n", pos[0], pos[1], pos[2], x, y, __LINE__);
+                PROFILE_COUNT(PC_CDTExceptions, 1);
                 return LXe_FAILED;
             }
-            z_ave += z;
         }
 
-        // averaged z value on axis plane
-        z_ave /= static_cast<double>(source.size());
-
-        // Set vertex projected positions and edge links.
+        // Set edge links except keyhole bridges.
+        std::vector<char> bridge;
+        MeshUtil::KeyholeBridges(source, bridge);
         for (auto i = 0u; i < nvert; i++)
         {
-            LXtPointID vrt, vrt1;
-            vrt  = source[i];
-            vrt1 = source[(i + 1) % nvert];
-            point.Select(vrt);
-            point1.Select(vrt1);
-            if (MeshUtil::IsKeyholeBridge(point, point1, source))
-            {
+            if (bridge[i])
                 continue;
-            }
-            int v1 = indices[vrt];
-            int v2 = indices[vrt1];
+            auto v1 = i;
+            auto v2 = (i + 1) % nvert;
             try
             {
                 cdt.insert_constraint(vertex_handles[v1], vertex_handles[v2]);
             }
             catch(...)
             {
-                printf("CGAL Error v1 (%d) v2 (%d) line (%d)\n", v1, v2, __LINE__);
+                PROFILE_COUNT(PC_CDTExceptions, 1);
                 return LXe_FAILED;
             }
         }
@@ -144,7 +254,7 @@ public:
         }
         catch(...)
         {
-            printf("CGAL Error line (%d)\n", __LINE__);
+            PROFILE_COUNT(PC_CDTExceptions, 1);
             return LXe_FAILED;
         }
 
@@ -152,15 +262,6 @@ public:
 
         tris.clear();
 
-        // Make a map to get index from vertex handle.
-        std::unordered_map<Vertex_handle,int> vertex_to_index;
-        int index = 0;
-        for (auto vertex = cdt.finite_vertices_begin(); vertex != cdt.finite_vertices_end(); vertex++)
-        {
-            vertex_to_index[vertex] = index++;
-        }
-        assert(static_cast<size_t>(index) == source.size());
-
         // Make triangle face polygons into the edit mesh.
         for (auto face = cdt.finite_faces_begin(); face != cdt.finite_faces_end(); face++)
         {
@@ -171,9 +272,10 @@ public:
             // Get three vertices of the triangle
             for (auto i = 0; i < 3; i++)
             {
-                Vertex_handle vh = face->vertex(i);
-                index = vertex_to_index[vh];
-                vert[i] = source[index];
+                auto it = handle_points.find(face->vertex(i));
+                if (it == handle_points.end())
+                    return LXe_FAILED;
+                vert[i] = it->second;
             }
             // Store a new triangle vertices
             tris.push_back(vert);
@@ -182,9 +284,14 @@ public:
         return LXe_OK;
     }
 
+    // Polygons with more vertices than this use CVertexGrid for the ear test.
+    static const unsigned GridThreshold = 64;
+
     // Triangulate the polygon by ear clipping method.
     // This method is known as ear clipping and sometimes ear trimming. An efficient algorithm for 
     // cutting off ears was discovered by Hossam ElGindy, Hazel Everett, and Godfried Toussaint.
+    // The remaining vertices are kept in a linked list of indices into the cached positions, and
+    // the next ear is searched from the neighbor of the last clipped one.
     LxResult EarClipping(AxisPlane& axisPlane, std::vector<LXtPointID>& source, std::vector<std::vector<LXtPointID>>& tris)
     {
         if (source.size() < 3)
@@ -196,55 +303,113 @@ public:
             return LXe_OK;
         }
 
-        CLxUser_Point point, point1;
-        point.fromMesh(m_mesh);
-        point1.fromMesh(m_mesh);
+        CPolygon2D poly(m_mesh, axisPlane, source);
+        auto n = poly.Size();
 
-        auto orient = MeshUtil::VertexListOrientation(m_mesh, axisPlane, source);
+        auto orient = poly.Orientation();
         LXtVector n0, n1;
-        MeshUtil::TriangleNormal(m_mesh, source.back(), source.front(), source[1], n0);
+        poly.Normal(n - 1, 0, 1, n0);
         bool flip = false;
         bool done = false;
 
-        std::vector<LXtPointID> verts = source;
+        std::vector<unsigned> prev(n), next(n);
+        std::vector<char>     alive(n, 1);
+        for (auto i = 0u; i < n; i++)
+        {
+            prev[i] = (i + n - 1) % n;
+            next[i] = (i + 1) % n;
+        }
+
+        std::unique_ptr<CVertexGrid> grid;
+        if (n > GridThreshold)
+            grid.reset(new CVertexGrid(poly));
 
-        while (verts.size() > 3)
+        unsigned remain = n;
+        unsigned curr   = 0;
+        while (remain > 3)
         {
-            LXtPointID vp = verts.back();
-            LXtPointID vc = verts.front();
-            LXtPointID vn = verts[1];
-            auto index = 0u;
-            for (auto i = 0u; i < verts.size(); i++)
+            // Degenerated polygons can run out of ears. The caller falls back to a simple fan.
+            bool found = false;
+            for (auto i = 0u; i < remain && !found; i++)
             {
-                vn = vp;
-                vp = vc;
-                vc = verts[(i + 1) % verts.size()];
-                if (MeshUtil::TriangleOriented(m_mesh, axisPlane, verts, orient, vn, vp, vc))
-                {
-                    index = i;
-                    break;
-                }
+                found = IsEar(poly, grid.get(), source, alive, next, orient, prev[curr], curr, next[curr]);
+                if (!found)
+                    curr = next[curr];
+            }
+            if (!found)
+            {
+                tris.clear();
+                return LXe_FAILED;
             }
+            auto vp = prev[curr];
+            auto vn = next[curr];
             if (!done)
             {
-                MeshUtil::TriangleNormal(m_mesh, vp, vc, vn, n1);
+                poly.Normal(curr, vn, vp, n1);
                 flip = (LXx_VDOT(n0, n1) < 0.0);
                 done = true;
             }
             if (flip)
-                tris.push_back({vp, vn, vc});
+                tris.push_back({source[curr], source[vp], source[vn]});
             else
-                tris.push_back({vp, vc, vn});
+                tris.push_back({source[curr], source[vn], source[vp]});
 
-            verts.erase(verts.begin() + index);
+            alive[curr] = 0;
+            next[vp] = vn;
+            prev[vn] = vp;
+            remain --;
+            curr = vn;
         }
+        auto v0 = curr, v1 = next[v0], v2 = next[v1];
         if (flip)
-            tris.push_back({verts[0], verts[2], verts[1]});
+            tris.push_back({source[v0], source[v2], source[v1]});
         else
-            tris.push_back({verts[0], verts[1], verts[2]});
+            tris.push_back({source[v0], source[v1], source[v2]});
 
         return LXe_OK;
     }
 
+    //
+    // Check the orientation of the triangle (v1, v2, v3) and that no other remaining vertex is
+    // inside it.
+    //
+    static bool IsEar(const CPolygon2D& poly, const CVertexGrid* grid, const std::vector<LXtPointID>& source,
+                      const std::vector<char>& alive, const std::vector<unsigned>& next, bool orient,
+                      unsigned v1, unsigned v2, unsigned v3)
+    {
+        double d = poly.Determ(v1, v2, v3);
+        if ((d >= 0.0) != orient)
+            return false;
+
+        auto corner = [&](unsigned a, unsigned b, unsigned c) {
+            double dc = poly.Determ(a, b, c);
+            if (!dc)
+                return false;
+            return (dc > 0.0) == orient;
+        };
+        auto outside = [&](unsigned v) {
+            if (!alive[v])
+                return true;
+            if ((source[v] == source[v1]) || (source[v] == source[v2]) || (source[v] == source[v3]))
+                return true;
+            return corner(v2, v1, v) || corner(v1, v3, v) || corner(v3, v2, v);
+        };
+
+        if (grid)
+        {
+            double x0 = std::min({ poly.X(v1), poly.X(v2), poly.X(v3) });
+            double x1 = std::max({ poly.X(v1), poly.X(v2), poly.X(v3) });
+            double y0 = std::min({ poly.Y(v1), poly.Y(v2), poly.Y(v3) });
+            double y1 = std::max({ poly.Y(v1), poly.Y(v2), poly.Y(v3) });
+            return grid->Query(x0, y0, x1, y1, outside);
+        }
+        for (auto v = next[v3]; v != v1; v = next[v])
+        {
+            if (!outside(v))
+                return false;
+        }
+        return true;
+    }
+
     CLxUser_Mesh m_mesh;
 };
\ No newline at end of file
@@ -15,6 +15,11 @@
 #include <boost/geometry/geometries/point_xy.hpp>
 #include <boost/geometry/geometries/segment.hpp>
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <thread>
 #include <vector>
 #include <unordered_set>
 #include <tuple>
@@ -267,6 +272,26 @@ namespace MathUtil {
         LXx_VCROSS (norm, a, b);
         return lx::VectorNormalize (norm);
     }
+
+    //
+    // Morton code of the position in the box by interleaving 21 bits of each coordinate.
+    //
+    static uint64_t MortonCode(const double p[3], const double lo[3], const double hi[3])
+    {
+        uint64_t code = 0;
+        for (auto k = 0; k < 3; k++)
+        {
+            double   t = (hi[k] > lo[k]) ? (p[k] - lo[k]) / (hi[k] - lo[k]) : 0.0;
+            uint64_t x = static_cast<uint64_t>(std::min(std::max(t, 0.0), 1.0) * 2097151.0);
+            x = (x | (x << 32)) & 0x1f00000000ffffull;
+            x = (x | (x << 16)) & 0x1f0000ff0000ffull;
+            x = (x | (x << 8))  & 0x100f00f00f00f00full;
+            x = (x | (x << 4))  & 0x10c30c30c30c30c3ull;
+            x = (x | (x << 2))  & 0x1249249249249249ull;
+            code |= x << k;
+        }
+        return code;
+    }
 };
 
 
@@ -538,6 +563,129 @@ struct AxisTriangles
 };
 
 
+//
+// Thread utility functions.
+//
+namespace ThreadUtil {
+
+//
+// Number of worker threads for the given setting, where 0 uses the hardware concurrency.
+//
+static unsigned Concurrency(int threads)
+{
+    if (threads > 0)
+        return static_cast<unsigned>(threads);
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+//
+// Call func(begin, end) over contiguous ranges of [0, count) on worker threads. The ranges
+// are run on the calling thread when the count is smaller than grain per thread.
+//
+template <typename F>
+static void ParallelFor(size_t count, int threads, F func, size_t grain = 256)
+{
+    size_t nthread = std::min<size_t>(Concurrency(threads), (count + grain - 1) / grain);
+    if (nthread <= 1)
+    {
+        if (count > 0)
+            func(size_t(0), count);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(nthread - 1);
+    size_t chunk = (count + nthread - 1) / nthread;
+    for (auto t = 1u; t < nthread; t++)
+    {
+        size_t begin = t * chunk;
+        size_t end   = std::min(count, begin + chunk);
+        if (begin < end)
+            workers.emplace_back(func, begin, end);
+    }
+    func(size_t(0), std::min(count, chunk));
+    for (auto& worker : workers)
+        worker.join();
+}
+
+}; // ThreadUtil
+
+
+//
+// Vertex positions of a polygon and their projections on the axis plane, gathered once so that
+// the triangulation predicates work on vertex indices without selecting the points.
+//
+struct CPolygon2D
+{
+    CPolygon2D(CLxUser_Mesh& mesh, AxisPlane& axisPlane, const std::vector<LXtPointID>& source)
+    {
+        CLxUser_Point point;
+        point.fromMesh(mesh);
+
+        auto nvert = source.size();
+        pos.resize(nvert * 3);
+        xy.resize(nvert * 2);
+        for (auto i = 0u; i < nvert; i++)
+        {
+            LXtFVector fpos;
+            point.Select(source[i]);
+            point.Pos(fpos);
+            double x, y, z;
+            axisPlane.ToPlane(fpos, x, y, z);
+            pos[i * 3 + 0] = fpos[0];
+            pos[i * 3 + 1] = fpos[1];
+            pos[i * 3 + 2] = fpos[2];
+            xy[i * 2 + 0] = x;
+            xy[i * 2 + 1] = y;
+            if (i == 0)
+            {
+                x_min = x_max = x;
+                y_min = y_max = y;
+                z_min = z_max = z;
+            }
+            x_min = std::min(x_min, x);
+            x_max = std::max(x_max, x);
+            y_min = std::min(y_min, y);
+            y_max = std::max(y_max, y);
+            z_min = std::min(z_min, z);
+            z_max = std::max(z_max, z);
+        }
+    }
+
+    unsigned Size() const { return static_cast<unsigned>(xy.size() / 2); }
+    double X(unsigned i) const { return xy[i * 2 + 0]; }
+    double Y(unsigned i) const { return xy[i * 2 + 1]; }
+    double Extent() const { return std::max(x_max - x_min, y_max - y_min); }
+
+    // Same as AxisPlane::Determ of the three vertices.
+    double Determ(unsigned i1, unsigned i2, unsigned i3) const
+    {
+        double a = (X(i2) - X(i1)) * (Y(i3) - Y(i1));
+        double b = (X(i3) - X(i1)) * (Y(i2) - Y(i1));
+        return a - b;
+    }
+
+    // Winding of the vertex list on the axis plane, true for counterclockwise.
+    bool Orientation() const
+    {
+        auto   n    = Size();
+        double area = X(n - 1) * Y(0) - X(0) * Y(n - 1);
+        for (auto i = 1u; i < n; i++)
+            area += X(i - 1) * Y(i) - X(i) * Y(i - 1);
+        return (area >= 0.0);
+    }
+
+    // Normal of the triangle of the three vertices.
+    bool Normal(unsigned i0, unsigned i1, unsigned i2, LXtVector norm) const
+    {
+        return MathUtil::CrossNormal(norm, &pos[i0 * 3], &pos[i1 * 3], &pos[i2 * 3]);
+    }
+
+    std::vector<double> pos;    // x, y, z of vertices
+    std::vector<double> xy;     // x, y of vertices on the axis plane
+    double x_min = 0.0, x_max = 0.0, y_min = 0.0, y_max = 0.0, z_min = 0.0, z_max = 0.0;
+};
+
 //
 // Polygon and vertex utility functions.
 //
@@ -569,33 +717,58 @@ static double PolygonTolerance(CLxUser_Polygon& polygon, CLxUser_Point& point)
 }
 
 //
-// Return true if the vertex pair is appeared twice.
+// Mark the keyhole bridge edges of the vertex list, where the vertex pair of the edge appears
+// twice and both vertices appear more than once. bridge[i] is for the edge from vertices[i] to
+// the next vertex. The edges are sorted once instead of scanning the list for each edge. This
+// returns the number of bridge edges.
 //
-static bool IsKeyholeBridge(CLxUser_Point& point, CLxUser_Point& point1, std::vector<LXtPointID>& polygon_vertices)
+static unsigned KeyholeBridges(const std::vector<LXtPointID>& vertices, std::vector<char>& bridge)
 {
-    CLxUser_MeshService s_mesh;
-    LXtMarkMode mark_dupl = s_mesh.SetMode(LXsMARK_USER_0);
+    typedef std::pair<LXtPointID,LXtPointID> Pair;
 
-    if (point.TestMarks(mark_dupl) == LXe_FALSE)
-        return false;
-    if (point1.TestMarks(mark_dupl) == LXe_FALSE)
-        return false;
+    auto n = vertices.size();
+    bridge.assign(n, 0);
 
-    LXtPointID vrt0, vrt1;
-    vrt0 = point.ID();
-    vrt1 = point1.ID();
-    unsigned count = 0;
+    std::vector<LXtPointID> sorted(vertices);
+    std::sort(sorted.begin(), sorted.end(), std::less<LXtPointID>());
+    auto repeated = [&](LXtPointID v) {
+        auto range = std::equal_range(sorted.begin(), sorted.end(), v, std::less<LXtPointID>());
+        return (range.second - range.first) > 1;
+    };
+
+    std::vector<std::pair<Pair,unsigned>> edges(n);
+    for (auto i = 0u; i < n; i++)
+    {
+        LXtPointID a = vertices[i];
+        LXtPointID b = vertices[(i + 1) % n];
+        if (std::less<LXtPointID>()(b, a))
+            std::swap(a, b);
+        edges[i] = std::make_pair(std::make_pair(a, b), i);
+    }
+    std::sort(edges.begin(), edges.end(), [](const std::pair<Pair,unsigned>& x, const std::pair<Pair,unsigned>& y) {
+        if (x.first.first != y.first.first)
+            return std::less<LXtPointID>()(x.first.first, y.first.first);
+        if (x.first.second != y.first.second)
+            return std::less<LXtPointID>()(x.first.second, y.first.second);
+        return x.second < y.second;
+    });
 
-    for (auto i = 0u; i < polygon_vertices.size(); i++)
+    unsigned count = 0;
+    for (auto i = 0u; i < n;)
     {
-        auto j = (i + 1) % polygon_vertices.size();
-        if ((polygon_vertices[i] == vrt0 && polygon_vertices[j] == vrt1) ||
-            (polygon_vertices[i] == vrt1 && polygon_vertices[j] == vrt0))
+        auto j = i + 1;
+        while (j < n && edges[j].first == edges[i].first)
+            j++;
+        const Pair& e = edges[i].first;
+        if ((j - i == 2) && (e.first != e.second) && repeated(e.first) && repeated(e.second))
         {
-            count ++;
+            bridge[edges[i].second]     = 1;
+            bridge[edges[i + 1].second] = 1;
+            count += 2;
         }
+        i = j;
     }
-    return count == 2;
+    return count;
 }
 
 
@@ -683,95 +856,88 @@ static double LoopAreaSize(CLxUser_Mesh& mesh, AxisPlane& axisPlane, std::vector
 //
 static bool MakeBoundaryVertexList(CLxUser_Mesh& mesh, CLxUser_Polygon& polygon, std::vector<LXtPointID>& vertices, std::vector<std::vector<LXtPointID>>& loops)
 {
-    CLxUser_Point point0, point1;
-    point0.fromMesh(mesh);
-    point1.fromMesh(mesh);
-
     vertices.clear();
     loops.clear();
 
-    std::unordered_map<LXtPointID,unsigned> indices;
-    MakeVertexTable(polygon, point0, vertices, indices);
-    printf("MakeBoundaryVertexList vertices = %lu indices = %lu\n", vertices.size(), indices.size());
-
-    unsigned nbridge = 0;
-
-    std::vector<std::pair<LXtPointID,LXtPointID>> edges;
-
     unsigned nvert;
     polygon.VertexCount(&nvert);
 
-    std::vector<LXtPointID> polygon_vertices;
-
+    std::vector<LXtPointID> polygon_vertices(nvert);
     for (auto i = 0u; i < nvert; i++)
     {
-        LXtPointID vrt;
-        polygon.VertexByIndex(i, &vrt);
-        polygon_vertices.push_back(vrt);
+        polygon.VertexByIndex(i, &polygon_vertices[i]);
     }
 
-    for (auto i = 0u; i < nvert; i++)
+    std::vector<char> bridge;
+    if (!KeyholeBridges(polygon_vertices, bridge))
     {
-        LXtPointID vrt0, vrt1;
-        polygon.VertexByIndex(i, &vrt0);
-        polygon.VertexByIndex((i + 1) % nvert, &vrt1);
-        point0.Select(vrt0);
-        point1.Select(vrt1);
-        if (IsKeyholeBridge(point0, point1, polygon_vertices))
-        {
-            nbridge ++;
-        }
-        else
-        {
-            edges.push_back(std::make_pair(vrt0, vrt1));
-        }
+        return false;
     }
 
-    //printf("** edges = %lu nbridge = %u\n", edges.size(), nbridge);
-    if (!nbridge)
+    // The edges except bridges sorted by the start vertex to link the loops. A vertex may
+    // start more than one edge when loops touch, so each run keeps its next unused edge.
+    std::vector<std::pair<LXtPointID,unsigned>> starts;
+    for (auto i = 0u; i < nvert; i++)
     {
-        return false;
+        if (!bridge[i])
+            starts.push_back(std::make_pair(polygon_vertices[i], i));
     }
-
-    // split the polygon into loops
-    std::vector<LXtPointID> loop;
-    std::pair<LXtPointID,LXtPointID> edge;
-
-    while (edges.size() > 0)
+    std::sort(starts.begin(), starts.end(), [](const std::pair<LXtPointID,unsigned>& x, const std::pair<LXtPointID,unsigned>& y) {
+        if (x.first != y.first)
+            return std::less<LXtPointID>()(x.first, y.first);
+        return x.second < y.second;
+    });
+    std::vector<unsigned> cursor(starts.size());
+    for (auto i = 0u; i < starts.size(); i++)
     {
-        if (loop.empty())
+        cursor[i] = i;
+    }
+    std::vector<char> used(nvert, 0);
+
+    auto next_edge = [&](LXtPointID v) -> int {
+        auto it = std::lower_bound(starts.begin(), starts.end(), std::make_pair(v, 0u),
+                                   [](const std::pair<LXtPointID,unsigned>& x, const std::pair<LXtPointID,unsigned>& y) {
+                                       if (x.first != y.first)
+                                           return std::less<LXtPointID>()(x.first, y.first);
+                                       return x.second < y.second;
+                                   });
+        if (it == starts.end() || it->first != v)
+            return -1;
+        auto  run = static_cast<unsigned>(it - starts.begin());
+        auto& k   = cursor[run];
+        while (k < starts.size() && starts[k].first == v)
         {
-            edge = edges.front();
-            edges.erase(edges.begin());
-            loop.push_back(edge.first);
-            printf ("** new loop edges = %lu first (%p) second (%p)\n", edges.size(), edge.first, edge.second);
+            unsigned e = starts[k++].second;
+            if (!used[e])
+                return static_cast<int>(e);
         }
+        return -1;
+    };
 
-        bool found = false;
-        for(auto it = edges.begin(); it != edges.end();)
-        {
-            if (it->first == edge.second)
-            {
-                printf("-- found next edge first (%p) second (%p) loop = %lu edges = %lu\n", it->first, it->second, loop.size(), edges.size());
-                loop.push_back(it->first);
-                edge = *it;
-                if (it->second == loop[0])
-                {
-                    loops.push_back(loop);
-                    loop.clear();
-                    printf ("** close loop loops = %lu\n", loops.size());
-                }
-                it = edges.erase(it);
-                found = true;
-            }
-            else
-                it++;
-        }
-        if (!found)
+    // split the polygon into loops
+    for (auto i = 0u; i < nvert; i++)
+    {
+        if (bridge[i] || used[i])
+            continue;
+        std::vector<LXtPointID> loop;
+        unsigned e = i;
+        while (true)
         {
-            printf("** not found loop edges = %lu\n", edges.size());
-            return false;
+            used[e] = 1;
+            loop.push_back(polygon_vertices[e]);
+            LXtPointID v = polygon_vertices[(e + 1) % nvert];
+            if (v == loop.front())
+                break;
+            int next = next_edge(v);
+            if (next < 0)
+                return false;
+            e = static_cast<unsigned>(next);
         }
+        loops.push_back(loop);
+    }
+    if (loops.empty())
+    {
+        return false;
     }
 
     // find the outer loop
@@ -874,102 +1040,188 @@ static bool IsIntersected(CLxVector p0, CLxVector p1, CLxVector q0, CLxVector q1
     return true;
 }
 
-static bool BridgeIsIntesected(CLxVector p0, CLxVector p1, std::vector<CLxVector>& loop)
+//
+// Return true if the point v is inside or on the triangle (p0, p1, p2) on the axis plane.
+//
+static bool PointInTriangle(CLxVector p0, CLxVector p1, CLxVector p2, CLxVector v)
+{
+    double d0 = (p1[0] - p0[0]) * (v[1] - p0[1]) - (p1[1] - p0[1]) * (v[0] - p0[0]);
+    double d1 = (p2[0] - p1[0]) * (v[1] - p1[1]) - (p2[1] - p1[1]) * (v[0] - p1[0]);
+    double d2 = (p0[0] - p2[0]) * (v[1] - p2[1]) - (p0[1] - p2[1]) * (v[0] - p2[0]);
+    bool neg = (d0 < 0.0) || (d1 < 0.0) || (d2 < 0.0);
+    bool pos = (d0 > 0.0) || (d1 > 0.0) || (d2 > 0.0);
+    return !(neg && pos);
+}
+
+//
+// Find the loop vertex visible from the hole vertex m to make a keyhole bridge. This casts a
+// ray from m toward +x on the axis plane and takes the end of the nearest hit edge with the
+// larger x. When other loop vertices are inside the triangle of m, the hit point and that end,
+// the one with the smallest angle to the ray is taken instead (Eberly).
+//
+static unsigned BridgeVertex(CLxVector m, std::vector<CLxVector>& loop)
 {
-    for (auto i = 0u; i < loop.size(); i++)
+    auto   n      = loop.size();
+    double mx     = m[0];
+    double my     = m[1];
+    double best_x = std::numeric_limits<double>::max();
+    int    hit    = -1;
+
+    for (auto i = 0u; i < n; i++)
     {
-        auto j = (i + 1) % loop.size();
-        if (IsIntersected(p0, p1, loop[i], loop[j]))
-            return true;
+        CLxVector a = loop[i];
+        CLxVector b = loop[(i + 1) % n];
+        if ((a[1] < my && b[1] < my) || (a[1] > my && b[1] > my))
+            continue;
+        double x;
+        if (a[1] == b[1])
+            x = (std::min(a[0], b[0]) >= mx) ? std::min(a[0], b[0]) : std::max(a[0], b[0]);
+        else
+            x = a[0] + (my - a[1]) * (b[0] - a[0]) / (b[1] - a[1]);
+        if (x >= mx && x < best_x)
+        {
+            best_x = x;
+            hit    = static_cast<int>(i);
+        }
     }
-    return false;
+
+    // No edge on the right side, take the nearest vertex.
+    if (hit < 0)
+    {
+        unsigned index = 0;
+        double   dmin  = std::numeric_limits<double>::max();
+        for (auto i = 0u; i < n; i++)
+        {
+            double d = (loop[i] - m).length();
+            if (d < dmin)
+            {
+                dmin  = d;
+                index = i;
+            }
+        }
+        return index;
+    }
+
+    unsigned i0 = static_cast<unsigned>(hit);
+    unsigned i1 = (i0 + 1) % n;
+    unsigned p  = (loop[i0][0] > loop[i1][0]) ? i0 : i1;
+    if (loop[i0][0] == best_x && loop[i0][1] == my)
+        return i0;
+    if (loop[i1][0] == best_x && loop[i1][1] == my)
+        return i1;
+
+    CLxVector hit_pos(best_x, my, 0.0);
+    CLxVector pp = loop[p];
+    double    tmin = std::numeric_limits<double>::max();
+    double    dmin = std::numeric_limits<double>::max();
+    unsigned  index = p;
+    for (auto i = 0u; i < n; i++)
+    {
+        if (i == p || loop[i][0] <= mx)
+            continue;
+        if (!PointInTriangle(m, hit_pos, pp, loop[i]))
+            continue;
+        double t = std::abs(loop[i][1] - my) / (loop[i][0] - mx);
+        double d = (loop[i] - m).length();
+        if (t < tmin || (t == tmin && d < dmin))
+        {
+            tmin  = t;
+            dmin  = d;
+            index = i;
+        }
+    }
+    return index;
 }
 
 //
 // Merge holes with outer loop and make a keyhole polygon. This ignores selected edges even if they are on border.
+// The holes are bridged in descending order of their maximum x on the axis plane from their
+// rightmost vertex, so that a bridge never crosses the keyhole or the holes left. Each hole
+// costs a linear pass over the keyhole. The positions are the loops projected on the axis plane.
 //
-static void MakeKeyhole(CLxUser_Mesh& mesh, AxisPlane& axisPlane, std::vector<LXtPointID>& outer, std::vector<std::vector<LXtPointID>>& holes, std::vector<LXtPointID>& keyhole)
+static void MakeKeyhole(const std::vector<LXtPointID>& outer, const std::vector<CLxVector>& outer_vectors,
+                        const std::vector<std::vector<LXtPointID>>& holes, const std::vector<std::vector<CLxVector>>& hole_vectors,
+                        std::vector<LXtPointID>& keyhole)
 {
-    std::vector<CLxVector> outer_vectors;
+    std::vector<CLxVector> keyhole_vectors(outer_vectors);
     keyhole = outer;
 
-    CLxUser_Point point;
-    point.fromMesh(mesh);
-    CLxUser_MeshService s_mesh;
-    LXtMarkMode mark_used = s_mesh.ClearMode(LXsMARK_USER_1);
-    for (auto v : keyhole)
+    std::vector<unsigned> order, rightmost(holes.size(), 0);
+    for (auto h = 0u; h < holes.size(); h++)
     {
-        point.Select(v);
-        point.SetMarks(mark_used);
+        if (holes[h].empty())
+            continue;
+        for (auto j = 1u; j < hole_vectors[h].size(); j++)
+        {
+            if (hole_vectors[h][j][0] > hole_vectors[h][rightmost[h]][0])
+                rightmost[h] = j;
+        }
+        order.push_back(h);
     }
-    mark_used = s_mesh.SetMode(LXsMARK_USER_1);
+    std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+        return hole_vectors[a][rightmost[a]][0] > hole_vectors[b][rightmost[b]][0];
+    });
 
-    printf("MakeKeyhole outer.size() = %lu holes = %lu\n", outer.size(), holes.size());
-    for (auto& hole : holes)
+    std::vector<LXtPointID> temp;
+    std::vector<CLxVector>  temp_vectors;
+    for (auto h : order)
     {
-        MakePositionVectors(mesh, axisPlane, keyhole, outer_vectors);
-        printf("-- hole.size() = %lu\n", hole.size());
-        std::vector<CLxVector> hole_vectors;
-        MakePositionVectors(mesh, axisPlane, hole, hole_vectors);
-        double min_dist = std::numeric_limits<double>::max();
-        unsigned min_index = 0, hole_index = 0;
-        for (auto i = 0u; i < outer_vectors.size(); i++)
+        auto& hole = holes[h];
+        auto& hv   = hole_vectors[h];
+        auto  m    = rightmost[h];
+        auto  p    = BridgeVertex(hv[m], keyhole_vectors);
+
+        temp.clear();
+        temp_vectors.clear();
+        temp.reserve(keyhole.size() + hole.size() + 2);
+        temp_vectors.reserve(keyhole.size() + hole.size() + 2);
+        for (auto j = 0u; j <= p; j++)
         {
-            point.Select(keyhole[i]);
-            if (point.TestMarks(mark_used) == LXe_TRUE)
-                continue;
-            for (auto j = 0u; j < hole_vectors.size(); j++)
-            {
-                point.Select(hole[j]);
-                if (point.TestMarks(mark_used) == LXe_TRUE)
-                    continue;
-                double dist = (outer_vectors[i] - hole_vectors[j]).length();
-                if (dist < min_dist)
-                {
-                    if (BridgeIsIntesected(outer_vectors[i], hole_vectors[j], outer_vectors))
-                        continue;
-                    min_dist = dist;
-                    min_index = i;
-                    hole_index = j;
-                }
-            }
+            temp.push_back(keyhole[j]);
+            temp_vectors.push_back(keyhole_vectors[j]);
         }
-        std::vector<LXtPointID> temp;
-        for (auto j = 0u; j < keyhole.size(); j++)
+        for (auto k = 0u; k <= hole.size(); k++)
+        {
+            temp.push_back(hole[(m + k) % hole.size()]);
+            temp_vectors.push_back(hv[(m + k) % hole.size()]);
+        }
+        temp.push_back(keyhole[p]);
+        temp_vectors.push_back(keyhole_vectors[p]);
+        for (auto j = p + 1; j < keyhole.size(); j++)
         {
             temp.push_back(keyhole[j]);
-            if (j == min_index)
-            {
-                for (auto k = 0u; k < hole.size(); k++)
-                {
-                    temp.push_back(hole[(hole_index + k) % hole.size()]);
-                }
-                temp.push_back(hole[hole_index]);
-                temp.push_back(keyhole[j]);
-
-                point.Select(hole[hole_index]);
-                point.SetMarks(mark_used);
-                point.Select(keyhole[j]);
-                point.SetMarks(mark_used);
-            }
+            temp_vectors.push_back(keyhole_vectors[j]);
         }
-        keyhole = temp;
+        keyhole.swap(temp);
+        keyhole_vectors.swap(temp_vectors);
     }
-    printf("** keyhole.size() = %lu\n", keyhole.size());
+}
+
+static void MakeKeyhole(CLxUser_Mesh& mesh, AxisPlane& axisPlane, std::vector<LXtPointID>& outer, std::vector<std::vector<LXtPointID>>& holes, std::vector<LXtPointID>& keyhole)
+{
+    std::vector<CLxVector> outer_vectors;
+    MakePositionVectors(mesh, axisPlane, outer, outer_vectors);
+
+    std::vector<std::vector<CLxVector>> hole_vectors(holes.size());
+    for (auto h = 0u; h < holes.size(); h++)
+        MakePositionVectors(mesh, axisPlane, holes[h], hole_vectors[h]);
+
+    MakeKeyhole(outer, outer_vectors, holes, hole_vectors, keyhole);
 }
 
 //
 // Make border vertex loops in the mesh.
 //
-static bool FirstBorderEdge(CLxUser_Mesh& mesh, CLxUser_Edge& edge)
+static bool FirstBorderEdge(CLxUser_Mesh& mesh, CLxUser_Edge& edge, unsigned& start)
 {
     CLxUser_MeshService mesh_svc;
     LXtMarkMode mark_done = mesh_svc.SetMode(LXsMARK_USER_0);
     LXtMarkMode mark_select = mesh_svc.SetMode(LXsMARK_SELECT);
 
+    // The edges before start are done by the previous calls.
     unsigned nedge;
     mesh.EdgeCount(&nedge);
-    for (auto i = 0u; i < nedge; i++)
+    for (auto i = start; i < nedge; i++)
     {
         edge.SelectByIndex(i);
         if (edge.TestMarks(mark_done) == LXe_TRUE)
@@ -979,9 +1231,11 @@ static bool FirstBorderEdge(CLxUser_Mesh& mesh, CLxUser_Edge& edge)
         if (edge.IsBorder() == LXe_TRUE)
         {
             edge.SetMarks(mark_done);
+            start = i + 1;
             return true;
         }
     }
+    start = nedge;
     return false;
 }
 static bool NextBorderEdge(CLxUser_Mesh& mesh, CLxUser_Edge& edge, LXtPointID pntID, LXtPointID* nextID)
@@ -1071,8 +1325,8 @@ static bool MakeBorderLoops(CLxUser_Mesh& mesh, std::vector<std::vector<LXtPoint
 
     loops.clear();
 
-    unsigned idx;
-    while (FirstBorderEdge (mesh, edge))
+    unsigned idx, start = 0;
+    while (FirstBorderEdge (mesh, edge, start))
     {
         std::vector<LXtPointID> loop;
         LXtPointID pntID0, pntID1, pntID;
@@ -1174,57 +1428,10 @@ static bool IsDiscoEdge(CLxUser_Mesh& mesh, CLxUser_MeshMap& vmap, CLxUser_Edge
     return false;
 }
 
-static bool TriangleNormal(CLxUser_Mesh& mesh, LXtPointID v0, LXtPointID v1, LXtPointID v2, LXtVector norm)
-{
-    CLxUser_Point point;
-    point.fromMesh(mesh);
-
-    LXtFVector pos;
-    point.Select(v0);
-    point.Pos(pos);
-    LXtVector pos0;
-    LXx_VCPY(pos0, pos);
-
-    point.Select(v1);
-    point.Pos(pos);
-    LXtVector pos1;
-    LXx_VCPY(pos1, pos);
-
-    point.Select(v2);
-    point.Pos(pos);
-    LXtVector pos2;
-    LXx_VCPY(pos2, pos);
-
-    return MathUtil::CrossNormal(norm, pos0, pos1, pos2);
-}
-
 // Get the orientation of the give vertex list
 static bool VertexListOrientation(CLxUser_Mesh& mesh, AxisPlane& axisPlane, std::vector<LXtPointID>& points)
 {
-    CLxUser_Point point;
-    LXtFVector pos;
-    double x0, y0, x1, y1, z;
-
-    point.fromMesh(mesh);
-    point.Select(points.front());
-    point.Pos(pos);
-    axisPlane.ToPlane(pos, x0, y0, z);
-    point.Select(points.back());
-    point.Pos(pos);
-    axisPlane.ToPlane(pos, x1, y1, z);
-    double area = x1 * y0 - x0 * y1;
-
-    for (auto i = 1u; i < points.size(); i++)
-    {
-        point.Select(points[i]);
-        point.Pos(pos);
-        axisPlane.ToPlane(pos, x1, y1, z);
-        area += x0 * y1 - x1 * y0;
-        x0 = x1;
-        y0 = y1;
-    }
-
-	return (area >= 0.0);
+    return CPolygon2D(mesh, axisPlane, points).Orientation();
 }
 
 // Get vertex list of the given polygon. If the first vertex is not convex, it fixes the order of vertices.
@@ -1249,29 +1456,20 @@ static bool PolygonFixedVertexList(CLxUser_Mesh& mesh, CLxUser_Polygon& poly, st
     if (nvert < 4)
         return false;
 
-    auto orient = VertexListOrientation(mesh, axisPlane, points);
+    CPolygon2D cached(mesh, axisPlane, points);
+    auto orient = cached.Orientation();
 
     // The first vertex is convex
     int i = norm[axisPlane.m_axis] < 0.0;
     if ((i ^ orient))
         return false;
 
-    CLxUser_Point point;
-    point.fromMesh(mesh);
-
-    LXtFVector prev, curr, next;
     double dmax = 0.0;
     unsigned index = 0;
 
     for (auto i = 0u; i < nvert; i++)
     {
-        point.Select(points[(i - 1 + nvert) % nvert]);
-        point.Pos(prev);
-        point.Select(points[i]);
-        point.Pos(curr);
-        point.Select(points[(i + 1) % nvert]);
-        point.Pos(next);
-        double d = axisPlane.Determ(prev, curr, next);
+        double d = cached.Determ((i - 1 + nvert) % nvert, i, (i + 1) % nvert);
         if (((d >= 0.0) == orient) && (std::abs(d) >= dmax))
         {
             dmax = std::abs(d);
@@ -1298,50 +1496,5 @@ static bool PolygonFixedVertexList(CLxUser_Mesh& mesh, CLxUser_Polygon& poly, st
     return true;
 }
 
-static double TriangleDeterm (CLxUser_Mesh& mesh, AxisPlane& axisPlane, LXtPointID v1, LXtPointID v2, LXtPointID v3)
-{
-    CLxUser_Point point;
-    point.fromMesh(mesh);
-
-    LXtFVector pos1, pos2, pos3;
-
-    point.Select(v1);
-    point.Pos(pos1);
-    point.Select(v2);
-    point.Pos(pos2);
-    point.Select(v3);
-    point.Pos(pos3);
-
-    return axisPlane.Determ(pos1, pos2, pos3);
-}
-
-static bool TriangleCorner (CLxUser_Mesh& mesh, AxisPlane& axisPlane, bool orient, LXtPointID v1, LXtPointID v2, LXtPointID v3)
-{
-    double d = TriangleDeterm(mesh, axisPlane, v1, v2, v3);
-    if (!d)
-        return false;
-	return (d > 0.0) == orient;
-}
-
-// Check the orientation of the triangle on the axis plane in the given vertex list.
-static bool TriangleOriented (CLxUser_Mesh& mesh, AxisPlane& axisPlane, std::vector<LXtPointID>& points, bool orient, LXtPointID v1, LXtPointID v2, LXtPointID v3)
-{
-	// Check the determination of the triangle.
-    double d = TriangleDeterm(mesh, axisPlane, v1, v2, v3);
-	if ((d >= 0.0) != orient)
-		return false;
-
-	for (auto i = 0u; i < points.size(); i++) {
-		LXtPointID v = points[i];
-		if ((v == v1) || (v == v2) || (v == v3))
-			continue;
-		if (!TriangleCorner (mesh, axisPlane, orient, v2, v1, v) &&
-            !TriangleCorner (mesh, axisPlane, orient, v1, v3, v) &&
-            !TriangleCorner (mesh, axisPlane, orient, v3, v2, v))
-			return false;
-	}
-	return true;
-}
-
 }; // MeshUtil
 